@@ -6,16 +6,17 @@
 
 /* bitmap.c contains the code that handles the inode and block bitmaps */
 #include <string.h>
+#include <sys/stat.h>
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
 
 //// 将指定地址（addr）处的一块1024字节内存清零
 // 输入：eax = 0; ecx = 以字节为单位的数据块长度（BLOCK_SIZE/4）；edi ＝ 指定
-// 起始地址addr。
+// 起始地址addr。先清方向位，然后重复执行存储数据(0)。
 #define clear_block(addr) \
-__asm__ __volatile__ ("cld\n\t" \       // 清方向位
-	"rep\n\t" \                         // 重复执行存储数据(0).
+__asm__ __volatile__ ("cld\n\t" \
+	"rep\n\t" \
 	"stosl" \
 	::"a" (0),"c" (BLOCK_SIZE/4),"D" ((long) (addr)))
 
@@ -44,25 +45,113 @@ __asm__ __volatile__("btrl %2,%3\n\tsetnb %%al": \
 "=a" (res):"0" (0),"r" (nr),"m" (*(addr))); \
 res;})
 
-//// 从addr开始寻找第1个0值bit位。
-// 输入：%0-ecx(返回值)；%1-ecx(0); %2-esi(addr).
-// 在addr指定地址开始的位图中寻找第1个是0的bit位，并将其距离addr的bit位偏移
-// 值返回。addr是缓冲块数据区的地址，扫描寻找的范围是1024字节（8192bit位）。
-#define find_first_zero(addr) ({ \
-int __res; \
-__asm__ __volatile__ ("cld\n" \         // 清方向位
-	"1:\tlodsl\n\t" \                   // 取[esi]→eax.
-	"notl %%eax\n\t" \                  // eax中每位取反。
-	"bsfl %%eax,%%edx\n\t" \            // 从位0扫描eax中是1的第1个位，其偏移值→edx
-	"je 2f\n\t" \                       // 如果eax中全是0，则向前跳转到标号2处。
-	"addl %%edx,%%ecx\n\t" \            // 偏移值加入ecx(ecx是位图首个0值位的偏移值)
-	"jmp 3f\n" \                        // 向前跳转到标号3处
-	"2:\taddl $32,%%ecx\n\t" \          // 未找到0值位，则将ecx加1个字长的位偏移量32
-	"cmpl $8192,%%ecx\n\t" \            // 已经扫描了8192bit位(1024字节)
-	"jl 1b\n" \                         // 若还没有扫描完1块数据，则向前跳转到标号1处
-	"3:" \                              // 结束。此时ecx中是位偏移量。
-	:"=c" (__res):"c" (0),"S" (addr)); \
-__res;})
+//// 在addr开始的位图中寻找[start,limit)范围内的第1个0值bit位。
+// 返回该位距离addr的bit位偏移值，没有找到则返回limit。位图按长字扫描：长字取反
+// 后用bsfl指令找出其中第1个是1的位，也即原来第1个是0的位。
+static inline int find_next_zero(unsigned long * addr, int start, int limit)
+{
+	unsigned long word;
+	int i, bit;
+
+	if (start >= limit)
+		return limit;
+	i = start >> 5;
+	word = ~addr[i] & (~0UL << (start & 31));   // 屏蔽掉start之前的位
+	while (!word) {
+		if (++i >= (limit+31) >> 5)
+			return limit;
+		word = ~addr[i];
+	}
+	__asm__("bsfl %1,%0":"=r" (bit):"r" (word));
+	bit += i << 5;
+	return (bit < limit) ? bit : limit;
+}
+
+/*
+ * The bitmaps are searched from a rotating hint (or from the goal the
+ * caller gives), not from bit 0, and every bitmap block has a count of
+ * its free bits in the super-block, so full blocks are skipped without
+ * being looked at. The counts are set up by count_free_bits() when the
+ * super-block is read, and kept up to date here.
+ */
+
+//// 位图map中第i块的有效位数。nbits是整个位图的有效位数(超出设备范围的位不能分配)。
+static inline int map_limit(int i, int nbits)
+{
+	nbits -= i << 13;
+	return (nbits > 8192) ? 8192 : nbits;
+}
+
+//// 在位图map中分配一个0值bit位，置位后返回其位号。
+// nbits是位图的有效位数，nfree[]是各位图块中的空闲位数，goal是希望分配的位。函数先
+// 在goal所在的位图块中从goal开始向后找，然后依次(循环)扫描其余的位图块，最后再回到
+// goal所在块的开头。空闲位数为0的块直接跳过。没有空闲位则返回0(0号位总是已置位的)。
+static int alloc_bit(struct buffer_head ** map, unsigned short * nfree,
+	int nbits, int goal)
+{
+	struct buffer_head * bh;
+	int nblocks, i, j, k, limit;
+
+	if (nbits <= 0)
+		return 0;
+	if (goal < 0 || goal >= nbits)
+		goal = 0;
+	nblocks = (nbits + 8191) >> 13;
+	for (k = 0 ; k <= nblocks ; k++) {
+		i = ((goal >> 13) + k) % nblocks;
+		if (!nfree[i] || !(bh = map[i]))
+			continue;
+		limit = map_limit(i,nbits);
+		j = find_next_zero((unsigned long *) bh->b_data,
+			k ? 0 : (goal & 8191), limit);
+		if (j >= limit) {
+    // 只有从块开头找起时才能断定该块已满(计数有误)，此时修正计数。
+			if (k || !(goal & 8191))
+				nfree[i] = 0;
+			continue;
+		}
+		if (set_bit(j,bh->b_data))
+			panic("alloc_bit: bit already set");
+		nfree[i]--;
+		bh->b_dirt = 1;
+		return j + (i << 13);
+	}
+	return 0;
+}
+
+//// 统计超级块sb中i节点位图和逻辑块位图各块的空闲位数，并复位分配提示位置。
+// 在read_super()读入位图之后调用。
+void count_free_bits(struct super_block * sb)
+{
+	int i, j, limit, nbits;
+
+	nbits = sb->s_ninodes + 1;
+	for (i = 0 ; i < I_MAP_SLOTS ; i++) {
+		sb->s_ifree[i] = 0;
+		if (!sb->s_imap[i] || (limit = map_limit(i,nbits)) <= 0)
+			continue;
+		j = 0;
+		while ((j = find_next_zero((unsigned long *) sb->s_imap[i]->b_data,
+		    j,limit)) < limit) {
+			sb->s_ifree[i]++;
+			j++;
+		}
+	}
+	nbits = sb->s_nzones - sb->s_firstdatazone + 1;
+	for (i = 0 ; i < Z_MAP_SLOTS ; i++) {
+		sb->s_zfree[i] = 0;
+		if (!sb->s_zmap[i] || (limit = map_limit(i,nbits)) <= 0)
+			continue;
+		j = 0;
+		while ((j = find_next_zero((unsigned long *) sb->s_zmap[i]->b_data,
+		    j,limit)) < limit) {
+			sb->s_zfree[i]++;
+			j++;
+		}
+	}
+	sb->s_ihint = 1;
+	sb->s_zhint = 1;
+}
 
 //// 释放设备dev上数据区中的逻辑块block.
 // 复位指定逻辑块block对应的逻辑块位图bit位
@@ -105,50 +194,31 @@ void free_block(int dev, int block)
 		printk("block (%04x:%d) ",dev,block+sb->s_firstdatazone-1);
 		panic("free_block: bit already cleared");
 	}
-    // 最后置相应逻辑块位图所在缓冲区已修改标志。
+    // 最后置相应逻辑块位图所在缓冲区已修改标志，并增加该位图块的空闲位数。
 	sb->s_zmap[block/8192]->b_dirt = 1;
+	sb->s_zfree[block/8192]++;
 }
 
-//// 向设备申请一个逻辑块。
-// 函数首先取得设备的超级块，并在超级块中的逻辑块位图中寻找第一个0值bit位(代表一个
-// 空闲逻辑块)。然后位置对应逻辑块在逻辑块位图中的bit位。接着为该逻辑块在缓冲区中取得
-// 一块对应缓冲块。最后将该缓冲块清零，并设置其已更新标志和已修改标志。并返回逻辑块
-// 号。函数执行成功则返回逻辑块号，否则返回0.
-int new_block(int dev)
+//// 把逻辑块号goal转换成逻辑块位图中的位号(位图中位j对应逻辑块j+s_firstdatazone-1)。
+// 若没有给出goal或goal不在数据区中，则返回超级块中的分配提示位置，并置*hint=1，表示
+// 分配后要把提示位置移到新分配位的下一位。这样各个新文件依次(循环)分配在盘上，而不必
+// 每次都从头开始扫描位图。
+static int zone_goal(struct super_block * sb, int goal, int * hint)
+{
+	*hint = !(goal >= sb->s_firstdatazone && goal < sb->s_nzones);
+	if (*hint)
+		return sb->s_zhint;
+	return goal - (sb->s_firstdatazone - 1);
+}
+
+//// 在高速缓冲区中为设备dev上新分配的逻辑块block取得一个缓冲块，并将其清零。
+// 因为刚取得的逻辑块其引用次数一定为1(getblk()中会设置)，因此若不为1则停机。
+// 最后设置其已更新标志和已修改标志，并释放该缓冲块。
+static void clear_zone(int dev, int block)
 {
 	struct buffer_head * bh;
-	struct super_block * sb;
-	int i,j;
 
-    // 首先获取设备dev的超级块。如果指定设备的超级块不存在，则出错当机。然后扫描
-    // 文件系统的8块逻辑位图，寻找首个0值bit位，以寻找空闲逻辑块，获取放置该逻辑块的
-    // 块号。如果全部扫描完8块逻辑块位图的所有bit位(i >= 8 或 j >= 8192)还没找到0值
-    // bit位或者位图所在的缓冲块指针无效(bh=NULL)则返回0退出(没有空闲逻辑块)。
-	if (!(sb = get_super(dev)))
-		panic("trying to get new block from nonexistant device");
-	j = 8192;
-	for (i=0 ; i<8 ; i++)
-		if ((bh=sb->s_zmap[i]))
-			if ((j=find_first_zero(bh->b_data))<8192)
-				break;
-	if (i>=8 || !bh || j>=8192)
-		return 0;
-    // 接着设置找到的新逻辑块j对应逻辑块位图中的bit位。若对应bit位已经置位，则出错
-    // 停机。否则置存放位图的对应缓冲区块已修改标志。因为逻辑块位图仅表示盘上数据区
-    // 中逻辑块的占用情况，则逻辑块位图中bit位偏移值表示从数据区开始处算起的块号，
-    // 因此这里需要加上数据区第1个逻辑块的块号，把j转换成逻辑块号。此时如果新逻辑块
-    // 大于该设备上的总逻辑块数，则说明指定逻辑块在对应设备上不存在。申请失败，返回0退出。
-	if (set_bit(j,bh->b_data))
-		panic("new_block: bit already set");
-	bh->b_dirt = 1;
-	j += i*8192 + sb->s_firstdatazone-1;
-	if (j >= sb->s_nzones)
-		return 0;
-    // 然后在高速缓冲区中为该设备上指定的逻辑块号取得一个缓冲块，并返回缓冲块头指针。
-    // 因为刚取得的逻辑块其引用次数一定为1(getblk()中会设置)，因此若不为1则停机。
-    // 最后将新逻辑块清零，并设置其已更新标志和已修改标志。然后释放对应缓冲块，返回
-    // 逻辑块号。
-	if (!(bh=getblk(dev,j)))
+	if (!(bh=getblk(dev,block)))
 		panic("new_block: cannot get block");
 	if (bh->b_count != 1)
 		panic("new block: count is != 1");
@@ -156,9 +226,112 @@ int new_block(int dev)
 	bh->b_uptodate = 1;
 	bh->b_dirt = 1;
 	brelse(bh);
+}
+
+//// 向设备申请一个逻辑块。
+// 函数首先取得设备的超级块，并在超级块中的逻辑块位图中寻找一个0值bit位(代表一个
+// 空闲逻辑块)，并置位该bit位。接着为该逻辑块在缓冲区中取得一块对应缓冲块。最后将
+// 该缓冲块清零，并设置其已更新标志和已修改标志。并返回逻辑块号。参数goal是希望
+// 分配的逻辑块号(通常是文件前一个逻辑块的下一块，以使文件数据在盘上连续)，0表示
+// 没有要求。函数执行成功则返回逻辑块号，否则返回0.
+int new_block(int dev, int goal)
+{
+	struct super_block * sb;
+	int j, hint;
+
+    // 首先获取设备dev的超级块。如果指定设备的超级块不存在，则出错当机。然后在逻辑块
+    // 位图中从goal开始分配一个空闲位。alloc_bit()只在有效范围内寻找，因此得到的逻辑块
+    // 一定在设备上。没有空闲逻辑块则返回0退出。
+	if (!(sb = get_super(dev)))
+		panic("trying to get new block from nonexistant device");
+	goal = zone_goal(sb,goal,&hint);
+	if (!(j = alloc_bit(sb->s_zmap,sb->s_zfree,
+	    sb->s_nzones - sb->s_firstdatazone + 1,goal)))
+		return 0;
+	if (hint)
+		sb->s_zhint = j + 1;
+    // 最后把位号j转换成逻辑块号，将新逻辑块清零，返回逻辑块号。
+	j += sb->s_firstdatazone-1;
+	clear_zone(dev,j);
 	return j;
 }
 
+/*
+ * Every in-core regular file has a window of zones reserved for it in
+ * the zmap (i_prealloc_block, i_prealloc_count). The bits are set, so
+ * nobody else gets them, but the zones are not in the file yet. As long
+ * as the file is written sequentially its new zones come from the
+ * window, so they end up contiguous even if other files are written at
+ * the same time. A write anywhere else throws the window away and gets
+ * a new one. sys_fallocate() reserves windows as big as the range it is
+ * asked for. The unused part is given back by free_prealloc() when the
+ * last reference to the inode goes away, or the file is truncated.
+ */
+
+//// 释放i节点的预留窗口中还没有用到的逻辑块。
+void free_prealloc(struct m_inode * inode)
+{
+	int block = inode->i_prealloc_block;
+	int count = inode->i_prealloc_count;
+
+    // 先把窗口清空，因为free_block()可能会睡眠。
+	inode->i_prealloc_count = 0;
+	while (count-- > 0)
+		free_block(inode->i_dev,block++);
+}
+
+//// 为i节点预留一段最多count个连续的逻辑块，返回实际预留的块数(没有空闲块则返回0)。
+// 原来的预留窗口先被释放。预留从goal之后(或分配提示位置之后)的第一个空闲逻辑块开始，
+// 遇到已被占用的块或位图结束即停止，因此预留的块一定是连续的。预留的块只是在位图中
+// 置位，并不清零，由new_file_block()在真正用到时清零。
+int prealloc_blocks(struct m_inode * inode, int goal, int count)
+{
+	struct super_block * sb;
+	struct buffer_head * bh;
+	int nbits, hint, j, n;
+
+	if (inode->i_prealloc_count)
+		free_prealloc(inode);
+	if (!(sb = get_super(inode->i_dev)))
+		panic("trying to get new block from nonexistant device");
+	nbits = sb->s_nzones - sb->s_firstdatazone + 1;
+	goal = zone_goal(sb,goal,&hint);
+	if (!(j = alloc_bit(sb->s_zmap,sb->s_zfree,nbits,goal)))
+		return 0;
+    // 第一个块已由alloc_bit()置位。然后依次置位其后的空闲位，直到预留了count块，
+    // 或者遇到已置位(被占用)的位为止。set_bit()返回原bit位值，原来是1时什么也没有改变。
+	for (n = 1 ; n < count && j+n < nbits ; n++) {
+		if (!(bh = sb->s_zmap[(j+n)>>13]))
+			break;
+		if (set_bit((j+n)&8191,bh->b_data))
+			break;
+		sb->s_zfree[(j+n)>>13]--;
+		bh->b_dirt = 1;
+	}
+	if (hint)
+		sb->s_zhint = j + n;
+	inode->i_prealloc_block = j + sb->s_firstdatazone-1;
+	inode->i_prealloc_count = n;
+	return n;
+}
+
+//// 为文件inode申请一个逻辑块，并把它清零。goal与new_block()中的相同。
+// 若goal正好是预留窗口中的下一块(或者没有指定goal)，就直接从窗口中取，否则重新预留一个
+// 窗口：常规文件预留PREALLOC_ZONES块，其他(目录)只取一块。成功则返回逻辑块号，否则返回0.
+int new_file_block(struct m_inode * inode, int goal)
+{
+	int block;
+
+	if (!inode->i_prealloc_count || (goal && goal != inode->i_prealloc_block))
+		if (!prealloc_blocks(inode,goal,
+		    S_ISREG(inode->i_mode) ? PREALLOC_ZONES : 1))
+			return 0;
+	block = inode->i_prealloc_block++;
+	inode->i_prealloc_count--;
+	clear_zone(inode->i_dev,block);
+	return block;
+}
+
 //// 释放指定的i节点
 // 该函数首先判断参数给出的i节点号的有效性和课释放性。若i节点仍然在使用中则不能
 // 被释放。然后利用超级块信息对i节点位图进行操作，复位i节点号对应的i节点位图中
@@ -170,12 +343,12 @@ void free_inode(struct m_inode * inode)
 
     // 首先判断参数给出的需要释放的i节点有效性或合法性。如果i节点指针＝NULL，则
     // 退出。如果i节点上的设备号字段为0，则说明该节点没有使用。于是用0清空对应i
-    // 节点所占内存区并返回。memset()定义在include/string.h中，这里表示用0填写
-    // inode指针指定处、长度是sizeof(*inode)的内存快。
+    // 节点所占内存区并返回。clear_inode()在fs/inode.c中，它先把i节点从hash表中
+    // 取下，再用0填写整个i节点结构。
 	if (!inode)
 		return;
 	if (!inode->i_dev) {
-		memset(inode,0,sizeof(*inode));
+		clear_inode(inode);
 		return;
 	}
     // 如果此i节点还有其他程序引用，则不能释放，说明内核有问题，停机。如果文件
@@ -203,8 +376,10 @@ void free_inode(struct m_inode * inode)
     // 所占内存区。
 	if (clear_bit(inode->i_num&8191,bh->b_data))
 		printk("free_inode: bit already cleared.\n\r");
+	else
+		sb->s_ifree[inode->i_num>>13]++;
 	bh->b_dirt = 1;
-	memset(inode,0,sizeof(*inode));
+	clear_inode(inode);
 }
 
 //// 为设备dev建立一个新i节点。初始化并返回该新i节点的指针。
@@ -213,38 +388,29 @@ struct m_inode * new_inode(int dev)
 {
 	struct m_inode * inode;
 	struct super_block * sb;
-	struct buffer_head * bh;
-	int i,j;
+	int j;
 
     // 首先从内存i节点表(inode_table)中获取一个空闲i节点项，并读取指定设备的
-    // 超级块结构。然后扫描超级块中8块i节点位图，寻找首个0bit位，寻找空闲节点，
-    // 获取放置该i节点的节点号。如果全部扫描完还没找到，或者位图所在的缓冲块无效
-    // (bh=NULL),则放回先前申请的i节点表中的i节点，并返回NULL退出(没有空闲的i节点)。
+    // 超级块结构。然后从超级块中的分配提示位置开始在i节点位图中寻找空闲i节点并置位
+    // 其bit位，得到该i节点的节点号，再把提示位置移到它的下一位。如果没有找到，则放回
+    // 先前申请的i节点表中的i节点，并返回NULL退出(没有空闲的i节点)。
 	if (!(inode=get_empty_inode()))
 		return NULL;
 	if (!(sb = get_super(dev)))
 		panic("new_inode with unknown device");
-	j = 8192;
-	for (i=0 ; i<8 ; i++)
-		if ((bh=sb->s_imap[i]))
-			if ((j=find_first_zero(bh->b_data))<8192)
-				break;
-	if (!bh || j >= 8192 || j+i*8192 > sb->s_ninodes) {
+	if (!(j = alloc_bit(sb->s_imap,sb->s_ifree,sb->s_ninodes+1,sb->s_ihint))) {
 		iput(inode);
 		return NULL;
 	}
-    // 现在我们已经找到了还未使用的i节点号j。于是置位i节点j对应的i节点位图相应bit位。
-    // 然后置i节点位图所在缓冲块已修改标志。最后初始化该i节点结构(i_ctime是i节点内容改变时间)。
-	if (set_bit(j,bh->b_data))
-		panic("new_inode: bit already set");
-	bh->b_dirt = 1;
+	sb->s_ihint = j + 1;
 	inode->i_count=1;                           // 引用计数
 	inode->i_nlinks=1;                          // 文件目录项连接数
 	inode->i_dev=dev;                           // i节点所在的设备号
 	inode->i_uid=current->euid;                 // i节点所属用户ID
 	inode->i_gid=current->egid;                 // 组id
 	inode->i_dirt=1;                            // 已修改标志置位
-	inode->i_num = j + i*8192;                  // 对应设备中的i节点号
+	inode->i_num = j;                           // 对应设备中的i节点号
+	insert_inode_hash(inode);                   // 以后iget()能在hash表中找到它
 	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
 	return inode;
 }
@@ -23,7 +23,10 @@
 #include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
+#include <errno.h>
+
 #include <asm/system.h>
+#include <asm/segment.h>
 #include <asm/io.h>
 
 // 变量end是由编译时的连接程序ld生成，用于表明内核代码的末端，即指明内核模块某段位置。
@@ -38,26 +41,77 @@ extern void put_super(int);
 extern void invalidate_inodes(int);
 
 struct buffer_head * start_buffer = (struct buffer_head *) &end;
-struct buffer_head * hash_table[NR_HASH];           // NR_HASH ＝ 307项
-static struct buffer_head * free_list;              // 空闲缓冲块链表头指针
-static struct task_struct * buffer_wait = NULL;     // 等待空闲缓冲块而睡眠的任务队列
+// hash表本身也放在高速缓冲区的开始处(缓冲头结构之前)，其项数NR_HASH是在buffer_init()
+// 中根据缓冲块的数目确定的2的幂次，hash_bits是其对应的位数。
+struct buffer_head ** hash_table;
+int NR_HASH = 0;                                    // hash表项数
+static int hash_bits = 0;
+// hash查找的调试统计：查找次数、沿hash链比较过的缓冲块总数和最长的一次比较次数。
+// 平均链长即 hash_probes/hash_lookups。
+static unsigned long hash_lookups = 0;
+static unsigned long hash_probes = 0;
+static unsigned long hash_max_chain = 0;
+// 未被引用(b_count=0)的缓冲块按状态分别挂在三个双向循环LRU链表上：干净的、正在
+// 读写(上锁)的和已修改的。链表头是最久未用的缓冲块，释放的缓冲块加到链表尾部，
+// 因此getblk()只需取干净链表的头一项即可，不必再扫描整个缓冲区。被引用的缓冲块
+// 不在任何链表中。中断处理程序解锁缓冲块时也会改动链表，所以修改链表时要关中断。
+static struct buffer_head * lru_list[NR_LIST] = { NULL, };
+static int nr_lru[NR_LIST] = { 0, };                // 各LRU链表中的缓冲块数
+// 写回进程在bdflush_wait上睡眠。它每隔BDFLUSH_INTERVAL个滴答被do_timer()唤醒一次，
+// 或者在已修改的空闲缓冲块超过缓冲块总数的BDFLUSH_NFRACT%时被唤醒。每次从脏链表
+// 上取BDFLUSH_BATCH个缓冲块，按块号升序发出写请求。
+#define BDFLUSH_NFRACT 30
+#define BDFLUSH_BATCH 16
+static struct task_struct * bdflush_wait = NULL;
+// 各块设备的高速缓冲统计数据，在设备第一次用到时分配一项。表满以后的设备都记在
+// 设备号为0的bstat_overflow中。last_bstat缓存最近一次查到的表项。
+static struct bstat bstat_table[NR_BSTAT];
+static struct bstat bstat_overflow;
+static struct bstat * last_bstat = &bstat_overflow;
+static struct wait_queue * buffer_wait = NULL;  // 等待空闲缓冲块而睡眠的任务队列
 // 下面定义系统缓冲区中含有的缓冲块个数。这里，NR_BUFFERS是一个定义在linux/fs.h中的
 // 宏，其值即使变量名nr_buffers，并且在fs.h文件中声明为全局变量。大写名称通常都是一个
 // 宏名称，Linus这样编写代码是为了利用这个大写名称来隐含地表示nr_buffers是一个在内核
 // 初始化之后不再改变的“变量”。它将在后面的缓冲区初始化函数buffer_init中被设置。
 int NR_BUFFERS = 0;                                 // 系统含有缓冲区块的个数
 
+//// 取设备dev的高速缓冲统计数据项。
+// 总是返回一个有效的指针，因此调用者可以直接累加计数。
+struct bstat * get_bstat(int dev)
+{
+	struct bstat * p;
+
+	if (!dev)
+		return &bstat_overflow;
+	if (last_bstat->bs_dev == dev)
+		return last_bstat;
+	for (p = bstat_table ; p < bstat_table + NR_BSTAT ; p++) {
+		if (!p->bs_dev)
+			p->bs_dev = dev;
+		if (p->bs_dev == dev)
+			return last_bstat = p;
+	}
+	return &bstat_overflow;
+}
+
 //// 等待指定缓冲块解锁
 // 如果指定的缓冲块bh已经上锁就让进程不可中断地睡眠在该缓冲块的等待队列b_wait中。
 // 在缓冲块解锁时，其等待队列上的所有进程将被唤醒。虽然是在关闭中断(cli)之后
 // 去睡眠的，但这样做并不会影响在其他进程上下文中影响中断。因为每个进程都在自己的
 // TSS段中保存了标志寄存器EFLAGS的值，所以在进程切换时CPU中当前EFLAGS的值也随之
 // 改变。使用sleep_on进入睡眠状态的进程需要用wake_up明确地唤醒。
+// 若确实睡眠过，就把等待的时间(滴答数)记入该设备的统计数据。
 static inline void wait_on_buffer(struct buffer_head * bh)
 {
+	long start;
+
 	cli();                          // 关中断
-	while (bh->b_lock)              // 如果已被上锁则进程进入睡眠，等待其解锁
-		sleep_on(&bh->b_wait);
+	if (bh->b_lock) {
+		start = jiffies;
+		while (bh->b_lock)          // 如果已被上锁则进程进入睡眠，等待其解锁
+			sleep_on(&bh->b_wait);
+		get_bstat(bh->b_dev)->bs_wait += jiffies - start;
+	}
 	sti();                          // 开中断
 }
 
@@ -135,8 +189,10 @@ void inline invalidate_buffers(int dev)
 			continue;
 		wait_on_buffer(bh);
         // 由于进程执行过程睡眠等待，所以需要再判断一下缓冲区是否是指定设备的。
-		if (bh->b_dev == dev)
+		if (bh->b_dev == dev) {
 			bh->b_uptodate = bh->b_dirt = 0;
+			refile_buffer(bh);
+		}
 	}
 }
 
@@ -172,21 +228,85 @@ void check_disk_change(int dev)
 			put_super(super_block[i].s_dev);
 	invalidate_inodes(dev);
 	invalidate_buffers(dev);
+	invalidate_dev_pages(dev);
+	invalidate_names(dev);
 }
 
 // 下面两行代码是hash（散列）函数定义和Hash表项的计算宏
 // hash表的主要作用是减少查找比较元素所花费的时间。通过在元素的存储位置与关
 // 键字之间建立一个对应关系(hash函数)，我们就可以直接通过函数计算立刻查询到指定
 // 的元素。建立hash函数的指导条件主要是尽量确保散列在任何数组项的概率基本相等。
-// 建立函数的方法有多种，这里Linux-0.11主要采用了关键字除留余数法。因为我们
-// 寻找的缓冲块有两个条件，即设备号dev和缓冲块号block，因此设计的hash函数肯定
-// 需要包含这两个关键值。这两个关键字的异或操作只是计算关键值的一种方法。再对
-// 关键值进行MOD运算就可以保证函数所计算得到的值都处于函数数组项范围内。
-#define _hashfn(dev,block) (((unsigned)(dev^block))%NR_HASH)
+// 因为我们寻找的缓冲块有两个条件，即设备号dev和缓冲块号block，因此设计的hash
+// 函数肯定需要包含这两个关键值。原来的(dev^block)%307会使不同设备上的连续块
+// 相互冲突，这里把设备号移到高16位(MINIX的块号不超过16位)再与块号组合，然后
+// 采用乘法散列：乘以黄金分割常数后取乘积的高hash_bits位作为表项索引。
+#define _hashfn(dev,block) \
+((((((unsigned)(dev))<<16)^(unsigned)(block))*0x9e3779b1U)>>(32-hash_bits))
 #define hash(dev,block) hash_table[_hashfn(dev,block)]
 
-//// 从hash队列和空闲缓冲区队列中移走缓冲块。
-// hash队列是双向链表结构，空闲缓冲块队列是双向循环链表结构。
+// 缓冲块按其当前状态应该挂入的LRU链表。
+#define BUF_LIST(bh) ((bh)->b_lock ? BUF_LOCKED : \
+	((bh)->b_dirt ? BUF_DIRTY : BUF_CLEAN))
+
+//// 把缓冲块从所在的LRU链表中摘下。若不在任何链表中则什么也不做。
+// 调用者必须已经关闭中断。
+static inline void remove_from_lru(struct buffer_head * bh)
+{
+	if (!bh->b_next_free)
+		return;
+	nr_lru[bh->b_list]--;
+	if (bh->b_next_free == bh)
+		lru_list[bh->b_list] = NULL;
+	else {
+		bh->b_prev_free->b_next_free = bh->b_next_free;
+		bh->b_next_free->b_prev_free = bh->b_prev_free;
+		if (lru_list[bh->b_list] == bh)
+			lru_list[bh->b_list] = bh->b_next_free;
+	}
+	bh->b_next_free = bh->b_prev_free = NULL;
+}
+
+//// 把缓冲块加到与其状态对应的LRU链表尾部(最近使用端)。调用者必须已经关闭中断。
+static inline void put_last_lru(struct buffer_head * bh)
+{
+	struct buffer_head ** head;
+
+	bh->b_list = BUF_LIST(bh);
+	head = lru_list + bh->b_list;
+	if (++nr_lru[bh->b_list] * 100 > NR_BUFFERS * BDFLUSH_NFRACT &&
+	    bh->b_list == BUF_DIRTY)
+		wake_up(&bdflush_wait);
+	if (!*head) {
+		*head = bh->b_next_free = bh->b_prev_free = bh;
+		return;
+	}
+	bh->b_next_free = *head;
+	bh->b_prev_free = (*head)->b_prev_free;
+	(*head)->b_prev_free->b_next_free = bh;
+	(*head)->b_prev_free = bh;
+}
+
+//// 缓冲块的引用计数或锁定、修改标志改变后，把它重新归入正确的LRU链表。
+// 被引用的缓冲块不在任何链表中；未被引用的缓冲块若所在链表与其状态不符，则移到
+// 对应链表的尾部。该函数也会在中断处理程序(end_request())中被调用，所以这里保存
+// 并恢复标志寄存器，而不是简单地cli/sti。
+void refile_buffer(struct buffer_head * bh)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (bh->b_count)
+		remove_from_lru(bh);
+	else if (!bh->b_next_free || bh->b_list != BUF_LIST(bh)) {
+		remove_from_lru(bh);
+		put_last_lru(bh);
+	}
+	restore_flags(flags);
+}
+
+//// 从hash队列和LRU链表中移走缓冲块。
+// hash队列是双向链表结构，LRU链表是双向循环链表结构。
 static inline void remove_from_queues(struct buffer_head * bh)
 {
 /* remove from hash-queue */
@@ -198,24 +318,17 @@ static inline void remove_from_queues(struct buffer_head * bh)
     // 缓冲区。
 	if (hash(bh->b_dev,bh->b_blocknr) == bh)
 		hash(bh->b_dev,bh->b_blocknr) = bh->b_next;
-/* remove from free list */
-	if (!(bh->b_prev_free) || !(bh->b_next_free))
-		panic("Free block list corrupted");
-	bh->b_prev_free->b_next_free = bh->b_next_free;
-	bh->b_next_free->b_prev_free = bh->b_prev_free;
-    // 如果空闲链表头指向本缓冲区，则让其指向下一缓冲区。
-	if (free_list == bh)
-		free_list = bh->b_next_free;
+/* remove from lru list */
+	cli();
+	remove_from_lru(bh);
+	sti();
 }
 
-//// 将缓冲块插入空闲链表尾部，同时放入hash队列中。
+//// 将缓冲块放入hash队列中，若它未被引用则同时挂到对应LRU链表的尾部。
 static inline void insert_into_queues(struct buffer_head * bh)
 {
-/* put at end of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
+/* put at end of its lru list if unused */
+	refile_buffer(bh);
 /* put the buffer in new hash-queue if it has a device */
     // 请注意当hash表某项第1次插入项时，hash()计算值肯定为Null，因此此时得到
     // 的bh->b_next肯定是NULL，所以应该在bh->b_next不为NULL时才能给b_prev赋
@@ -226,7 +339,18 @@ static inline void insert_into_queues(struct buffer_head * bh)
 		return;
 	bh->b_next = hash(bh->b_dev,bh->b_blocknr);
 	hash(bh->b_dev,bh->b_blocknr) = bh;
-	bh->b_next->b_prev = bh;                // 此句前应添加"if (bh->b_next)"判断
+	if (bh->b_next)
+		bh->b_next->b_prev = bh;
+}
+
+// 被唤醒的等待空闲缓冲块的进程不一定会用掉一块空闲缓冲块(比如它要的块已经被
+// 别人读入高速缓冲了)。所以在getblk()返回前，若还有空闲缓冲块而又有进程在等，就
+// 再唤醒一个，免得空闲缓冲块闲置而进程却还在睡眠。
+static inline void pass_on_wakeup(void)
+{
+	if (buffer_wait && (lru_list[BUF_CLEAN] || lru_list[BUF_LOCKED] ||
+	    lru_list[BUF_DIRTY]))
+		wake_up_queue(&buffer_wait);
 }
 
 //// 利用hash表在高速缓冲区中寻找给定设备和指定块号的缓冲区块。
@@ -234,12 +358,44 @@ static inline void insert_into_queues(struct buffer_head * bh)
 static struct buffer_head * find_buffer(int dev, int block)
 {		
 	struct buffer_head * tmp;
+	unsigned long chain = 0;
 
-    // 搜索hash表，寻找指定设备号和块号的缓冲块。
-	for (tmp = hash(dev,block) ; tmp != NULL ; tmp = tmp->b_next)
+    // 搜索hash表，寻找指定设备号和块号的缓冲块。同时记录比较过的缓冲块数目。
+	hash_lookups++;
+	for (tmp = hash(dev,block) ; tmp != NULL ; tmp = tmp->b_next) {
+		chain++;
 		if (tmp->b_dev==dev && tmp->b_blocknr==block)
-			return tmp;
-	return NULL;
+			break;
+	}
+	hash_probes += chain;
+	if (chain > hash_max_chain)
+		hash_max_chain = chain;
+	return tmp;
+}
+
+//// 显示高速缓冲hash表的调试信息(由功能键经show_stat()调用)。
+// 除了查找时的统计数据外，还扫描一遍hash表，给出当前最长的链和非空链的平均长度。
+// 因为printk()不支持浮点数，平均值以十倍的整数形式给出。
+void show_buffer_hash(void)
+{
+	struct buffer_head * tmp;
+	int i, len, max = 0, used = 0, total = 0;
+
+	for (i=0 ; i<NR_HASH ; i++) {
+		len = 0;
+		for (tmp = hash_table[i] ; tmp ; tmp = tmp->b_next)
+			len++;
+		if (!len)
+			continue;
+		used++;
+		total += len;
+		if (len > max)
+			max = len;
+	}
+	printk("buffer hash: %d buckets, %d used, chain max %d avg*10 %d\n\r",
+		NR_HASH,used,max,used ? total*10/used : 0);
+	printk("lookups %d, probe max %d avg*10 %d\n\r",hash_lookups,
+		hash_max_chain,hash_lookups ? hash_probes*10/hash_lookups : 0);
 }
 
 /*
@@ -257,17 +413,26 @@ struct buffer_head * get_hash_table(int dev, int block)
 
 	for (;;) {
         // 在高速缓冲中寻找给定设备和指定块的缓冲区块，如果没有找到则返回NULL。
-		if (!(bh=find_buffer(dev,block)))
+		if (!(bh=find_buffer(dev,block))) {
+			get_bstat(dev)->bs_misses++;
 			return NULL;
-        // 对该缓冲块增加引用计数，并等待该缓冲块解锁。由于经过了睡眠状态，
-        // 因此有必要在验证该缓冲块的正确性，并返回缓冲块头指针。
+		}
+        // 对该缓冲块增加引用计数(被引用的缓冲块要从LRU链表中摘下)，并等待
+        // 该缓冲块解锁。由于经过了睡眠状态，因此有必要在验证该缓冲块的正确性，
+        // 并返回缓冲块头指针。
+		cli();
 		bh->b_count++;
+		remove_from_lru(bh);
+		sti();
 		wait_on_buffer(bh);
-		if (bh->b_dev == dev && bh->b_blocknr == block)
+		if (bh->b_dev == dev && bh->b_blocknr == block) {
+			get_bstat(dev)->bs_hits++;
 			return bh;
+		}
         // 如果在睡眠时该缓冲块所属的设备号或块设备号发生了改变，则撤消对它的
         // 引用计数，重新寻找。
 		bh->b_count--;
+		refile_buffer(bh);
 	}
 }
 
@@ -276,91 +441,78 @@ struct buffer_head * get_hash_table(int dev, int block)
  * race-conditions. Most of the code is seldom used, (ie repeating),
  * so it should be much more efficient than it looks.
  *
- * The algoritm is changed: hopefully better, and an elusive bug removed.
+ * The victim is no longer searched for: unused buffers are kept on
+ * clean/locked/dirty lru-lists, and we just take the oldest clean one.
  */
-// 下面宏用于同时判断缓冲区的修改标志和锁定标志，并且定义修改标志的权重要比锁定标志大。
-#define BADNESS(bh) (((bh)->b_dirt<<1)+(bh)->b_lock)
 //// 取高速缓冲中指定的缓冲块
 // 检查指定（设备号和块号）的缓冲区是否已经在高速缓冲中。如果指定块已经在
 // 高速缓冲中，则返回对应缓冲区头指针退出；如果不在，就需要在高速缓冲中设置一个
 // 对应设备号和块好的新项。返回相应的缓冲区头指针。
 struct buffer_head * getblk(int dev,int block)
 {
-	struct buffer_head * tmp, * bh;
+	struct buffer_head * bh;
 
 repeat:
     // 搜索hash表，如果指定块已经在高速缓冲中，则返回对应缓冲区头指针，退出。
-	if ((bh = get_hash_table(dev,block)))
+	if ((bh = get_hash_table(dev,block))) {
+		pass_on_wakeup();
 		return bh;
-    // 扫描空闲数据块链表，寻找空闲缓冲区。
-    // 首先让tmp指向空闲链表的第一个空闲缓冲区头
-	tmp = free_list;
-	do {
-        // 如果该缓冲区正被使用（引用计数不等于0），则继续扫描下一项。对于
-        // b_count = 0的块，即高速缓冲中当前没有引用的块不一定就是干净的
-        // (b_dirt=0)或没有锁定的(b_lock=0)。因此，我们还是需要继续下面的判断
-        // 和选择。例如当一个任务该写过一块内容后就释放了，于是该块b_count()=0
-        // 但b_lock不等于0；当一个任务执行breada()预读几个块时，只要ll_rw_block()
-        // 命令发出后，它就会递减b_count; 但此时实际上硬盘访问操作可能还在进行，
-        // 因此此时b_lock=1, 但b_count=0.
-		if (tmp->b_count)
-			continue;
-        // 如果缓冲头指针bh为空，或者tmp所指缓冲头的标志(修改、锁定)权重小于bh
-        // 头标志的权重，则让bh指向tmp缓冲块头。如果该tmp缓冲块头表明缓冲块既
-        // 没有修改也没有锁定标志置位，则说明已为指定设备上的块取得对应的高速
-        // 缓冲块，则退出循环。否则我们就继续执行本循环，看看能否找到一个BANDNESS()
-        // 最小的缓冲块。
-		if (!bh || BADNESS(tmp)<BADNESS(bh)) {
-			bh = tmp;
-			if (!BADNESS(tmp))
-				break;
-		}
-/* and repeat until we find something good */
-	} while ((tmp = tmp->b_next_free) != free_list);
-    // 如果循环检查发现所有缓冲块都正在被使用(所有缓冲块的头部引用计数都>0)中，
-    // 则睡眠等待有空闲缓冲块可用。当有空闲缓冲块可用时本进程会呗明确的唤醒。
-    // 然后我们跳转到函数开始处重新查找空闲缓冲块。
-	if (!bh) {
-		sleep_on(&buffer_wait);
-		goto repeat;
 	}
-    // 执行到这里，说明我们已经找到了一个比较合适的空闲缓冲块了。于是先等待该缓冲区
-    // 解锁。如果在我们睡眠阶段该缓冲区又被其他任务使用的话，只好重复上述寻找过程。
-	wait_on_buffer(bh);
-	if (bh->b_count)
-		goto repeat;
-    // 如果该缓冲区已被修改，则将数据写盘，并再次等待缓冲区解锁。同样地，若该缓冲区
-    // 又被其他任务使用的话，只好再重复上述寻找过程。
-	while (bh->b_dirt) {
-		sync_dev(bh->b_dev);
-		wait_on_buffer(bh);
-		if (bh->b_count)
+    // 取干净LRU链表的头一项，即最久未被使用的既没有修改也没有上锁的空闲缓冲块。
+    // 从get_hash_table()返回到这里我们没有睡眠过，所以指定块不可能被别人加入
+    // 高速缓冲。要关中断是因为磁盘中断可能正在把某个刚解锁的缓冲块挂进干净链表。
+	cli();
+	if (!(bh = lru_list[BUF_CLEAN])) {
+		sti();
+        // 没有干净的空闲缓冲块。若有正在读写的空闲缓冲块，就等待最早的那个解锁，
+        // 它解锁后会被中断处理程序移入干净链表。否则若有已修改的空闲缓冲块，则
+        // 唤醒写回进程，并只把最早的那一块写盘(而不是同步整个设备)，下一次循环
+        // 就会等待它写完。这两种情况下都需要重新开始寻找。
+		if ((bh = lru_list[BUF_LOCKED])) {
+			wait_on_buffer(bh);
 			goto repeat;
-	}
-/* NOTE!! While we slept waiting for this block, somebody else might */
-/* already have added "this" block to the cache. check it */
-    // 在高速缓冲hash表中检查指定设备和块的缓冲块是否乘我们睡眠之际已经被加入
-    // 进去。如果是的话，就再次重复上述寻找过程。
-	if (find_buffer(dev,block))
+		}
+		if ((bh = lru_list[BUF_DIRTY])) {
+			get_bstat(bh->b_dev)->bs_dirty_evict++;
+			wakeup_bdflush();
+			ll_rw_block(WRITE,bh);
+			goto repeat;
+		}
+    // 所有缓冲块都正在被使用(所有缓冲块的头部引用计数都>0)，则睡眠等待有空闲
+    // 缓冲块可用。当有空闲缓冲块可用时本进程会被明确的唤醒。
+		sleep_on_queue(&buffer_wait, 1);
 		goto repeat;
+	}
 /* OK, FINALLY we know that this buffer is the only one of it's kind, */
 /* and that it's unused (b_count=0), unlocked (b_lock=0), and clean */
     // 于是让我们占用此缓冲块。置引用计数为1，复位修改标志和有效(更新)标志。
 	bh->b_count=1;
 	bh->b_dirt=0;
 	bh->b_uptodate=0;
-    // 从hash队列和空闲队列块链表中移出该缓冲区头，让该缓冲区用于指定设备和
-    // 其上的指定块。然后根据此新的设备号和块号重新插入空闲链表和hash队列新
-    // 位置处。并最终返回缓冲头指针。
+	sti();
+	if (bh->b_dev)
+		get_bstat(bh->b_dev)->bs_evict++;
+    // 从hash队列和LRU链表中移出该缓冲区头，让该缓冲区用于指定设备和其上的指定块。
+    // 然后根据此新的设备号和块号重新插入hash队列新位置处。并最终返回缓冲头指针。
 	remove_from_queues(bh);
+	pass_on_wakeup();
 	bh->b_dev=dev;
 	bh->b_blocknr=block;
+    // 虚拟盘上的块不必在高速缓冲中再存一份：让b_data直接指向虚拟盘中的该块，
+    // 数据自然是有效的，读时不用复制，写时修改的就是虚拟盘本身。其他设备的块
+    // 则使用缓冲块自己的数据块。注意这只省去了复制，并不省内存：缓冲块自己的数据
+    // 块b_own_data仍为它保留着，映射虚拟盘期间闲置不用。
+	if ((bh->b_data = rd_map(dev,block)))
+		bh->b_uptodate = 1;
+	else
+		bh->b_data = bh->b_own_data;
 	insert_into_queues(bh);
 	return bh;
 }
 
 // 释放指定缓冲块。
-// 等待该缓冲块解锁。然后引用计数递减1，并明确地唤醒等待空闲缓冲块的进程。
+// 等待该缓冲块解锁。然后引用计数递减1，若已没有引用则把它挂到对应LRU链表的尾部，
+// 并唤醒一个等待空闲缓冲块的进程：多了一块空闲缓冲块，只够一个进程用。
 void brelse(struct buffer_head * buf)
 {
 	if (!buf)
@@ -368,7 +520,60 @@ void brelse(struct buffer_head * buf)
 	wait_on_buffer(buf);
 	if (!(buf->b_count--))
 		panic("Trying to free free buffer");
-	wake_up(&buffer_wait);
+	refile_buffer(buf);
+	if (!buf->b_count)
+		wake_up_queue(&buffer_wait);
+}
+
+//// 唤醒写回进程。
+void wakeup_bdflush(void)
+{
+	wake_up(&bdflush_wait);
+}
+
+//// 写回进程的系统调用。
+// 写回进程(init创建的任务2)循环调用本函数。进程先睡眠等待被唤醒，然后把唤醒时
+// 已在脏链表中的缓冲块写盘：每批从脏链表头(最久未用端)取BDFLUSH_BATCH块，增加
+// 其引用计数以免在我们睡眠时被getblk()挪作他用，按(设备号，块号)升序排好后依次
+// 发出写请求。写请求只是放入请求队列，本进程并不等待其完成。
+int sys_bdflush(void)
+{
+	struct buffer_head * bh, * tmp, * batch[BDFLUSH_BATCH];
+	int i, n, left;
+
+	if (!suser())
+		return -EPERM;
+	interruptible_sleep_on(&bdflush_wait);
+	if (current->signal & ~current->blocked)
+		return -EINTR;
+	left = nr_lru[BUF_DIRTY];
+	while (left > 0) {
+		cli();
+		for (n = 0 ; n < BDFLUSH_BATCH && (bh = lru_list[BUF_DIRTY]) ; n++) {
+			bh->b_count++;
+			remove_from_lru(bh);
+			for (i = n ; i > 0 ; i--) {
+				tmp = batch[i-1];
+				if (tmp->b_dev < bh->b_dev || (tmp->b_dev == bh->b_dev &&
+				    tmp->b_blocknr < bh->b_blocknr))
+					break;
+				batch[i] = tmp;
+			}
+			batch[i] = bh;
+		}
+		sti();
+		if (!n)
+			break;
+		for (i = 0 ; i < n ; i++) {
+			ll_rw_block(WRITE,batch[i]);
+			batch[i]->b_count--;
+			refile_buffer(batch[i]);
+			if (!batch[i]->b_count)
+				wake_up_queue(&buffer_wait);
+		}
+		left -= n;
+	}
+	return 0;
 }
 
 /*
@@ -411,11 +616,25 @@ __asm__("cld\n\t" \
 	::"c" (BLOCK_SIZE/4),"S" (from),"D" (to) \
 	)
 
+//// 把to位置的一块(1024 bytes)内存清零。
+#define CLEARBLK(to) \
+__asm__("cld\n\t" \
+	"rep\n\t" \
+	"stosl\n\t" \
+	::"a" (0),"c" (BLOCK_SIZE/4),"D" (to) \
+	)
+
 /*
  * bread_page reads four buffers into memory at the desired address. It's
  * a function of its own, as there is some speed to be got by reading them
  * all at the same time, not waiting for one to be read, and then another
  * etc.
+ *
+ * If the four blocks are adjacent on the disk and none of them is in the
+ * cache, the page is read with ll_rw_page() straight into place instead:
+ * one request, and no copying. If that fails, the blocks are read one
+ * by one through the cache, and the blocks that can't be read are left
+ * zeroed: the page may hold anything, and must not be mapped as it is.
  */
 //// 读设备上一个页面（4个缓冲块）的内容到指定内存地址。
 // 参数address是保存页面数据的地址：dev 是指定的设备号；b[4]是含有4个设备
@@ -425,6 +644,17 @@ void bread_page(unsigned long address,int dev,int b[4])
 	struct buffer_head * bh[4];
 	int i;
 
+    // 如果4个块号在设备上是连续的，并且高速缓冲中一块都没有(缓冲块中可能有
+    // 尚未写盘的新数据，那时必须以缓冲块为准)，就用一个8扇区的请求直接把整页
+    // 读到address处，省掉3个请求和4次复制。设备不支持这么大的请求或者读出错时
+    // ll_rw_page()返回0，仍按下面原来的方法通过高速缓冲读取。
+	if (b[0] && b[1] == b[0]+1 && b[2] == b[0]+2 && b[3] == b[0]+3) {
+		for (i=0 ; i<4 ; i++)
+			if (find_buffer(dev,b[i]))
+				break;
+		if (i == 4 && ll_rw_page(READ,dev,b[0],(char *) address))
+			return;
+	}
     // 该函数循环执行4次，根据放在数组b[]中的4个块号从设备dev中读取一页内容
     // 放到指定内存位置address处。对于参数b[i]给出的有效块号，函数首先从高速
     // 缓冲中取指定设备和块号的缓冲块。如果缓冲块中数据无效(未更新)则产生读
@@ -439,12 +669,15 @@ void bread_page(unsigned long address,int dev,int b[4])
 			bh[i] = NULL;
     // 随后将4个缓冲块上的内容顺序复制到指定地址处。在进行复制（使用）缓冲块之前
     // 我们先要睡眠等待缓冲块解锁，另外，因为可能睡眠过了，所以我们还需要在复制
-    // 之前再检查一下缓冲块中的数据是否是有效的。复制完后我们还需要释放缓冲块。
+    // 之前再检查一下缓冲块中的数据是否是有效的，无效(读出错)则把这一块清零，不能
+    // 留下页面中原有的内容。复制完后我们还需要释放缓冲块。
 	for (i=0 ; i<4 ; i++,address += BLOCK_SIZE)
 		if (bh[i]) {
 			wait_on_buffer(bh[i]);          // 等待缓冲块解锁
 			if (bh[i]->b_uptodate)          // 若缓冲块中数据有效则复制
 				COPYBLK((unsigned long) bh[i]->b_data,address);
+			else
+				CLEARBLK(address);
 			brelse(bh[i]);
 		}
 }
@@ -479,6 +712,7 @@ struct buffer_head * breada(int dev,int first, ...)
             // 因为这里是预读随后的数据块，只需读进高速缓冲区但并不是马上就使用，
             // 所以这句需要将其引用计数递减释放该块(因为getblk()函数会增加引用计数值)
 			tmp->b_count--;
+			refile_buffer(tmp);
 		}
 	}
     // 此时可变参数表中所有参数处理完毕。于是等待第一个缓冲区解锁，在等待退出之后，如果
@@ -491,6 +725,33 @@ struct buffer_head * breada(int dev,int first, ...)
 	return (NULL);
 }
 
+//// 取高速缓冲统计数据的系统调用。
+// 把统计表中第index个已使用的表项复制到用户空间buf处。index超出已使用的表项时返回
+// -ENOENT，因此用户程序可以从0开始依次调用，取得所有设备的统计数据。
+int sys_bstat(int index, struct bstat * buf)
+{
+	if (index < 0 || index >= NR_BSTAT || !bstat_table[index].bs_dev)
+		return -ENOENT;
+	verify_area(buf,sizeof(struct bstat));
+	memcpy_tofs(buf,bstat_table + index,sizeof(struct bstat));
+	return 0;
+}
+
+//// 预读指定设备上的一块数据。
+// 只对不在高速缓冲中的块发出READA请求，既不等待它读完，也不保留对缓冲块的引用。
+// 若请求队列已满，make_request()会直接放弃该预读请求。
+void bread_ahead(int dev,int block)
+{
+	struct buffer_head * bh;
+
+	if (!(bh=getblk(dev,block)))
+		return;
+	if (!bh->b_uptodate)
+		ll_rw_block(READA,bh);
+	bh->b_count--;
+	refile_buffer(bh);
+}
+
 // 缓冲区初始化函数
 // 参数buffer_end是缓冲区内存末端。对于具有16MB内存的系统，缓冲区末端被设置为4MB.
 // 对于有8MB内存的系统，缓冲区末端被设置为2MB。该函数从缓冲区开始位置start_buffer
@@ -498,7 +759,7 @@ struct buffer_head * breada(int dev,int first, ...)
 // 缓冲区中所有内存被分配完毕。
 void buffer_init(long buffer_end)
 {
-	struct buffer_head * h = start_buffer;
+	struct buffer_head * h;
 	void * b;
 	int i;
 
@@ -509,6 +770,16 @@ void buffer_init(long buffer_end)
 		b = (void *) (640*1024);
 	else
 		b = (void *) buffer_end;
+    // 然后确定hash表的大小。先粗略估计一下缓冲块的数目(每块需要1KB数据和一个缓冲头，
+    // 忽略640KB-1MB的空洞，因此只会估计偏大)，取不小于它的2的幂次作为hash表项数，使
+    // 平均链长不超过1。hash表放在缓冲区开始处，缓冲头结构紧跟在它的后面。
+	i = ((long) b - (long) start_buffer) / (BLOCK_SIZE + sizeof(struct buffer_head));
+	for (hash_bits = MIN_HASH_BITS ; (1<<hash_bits) < i ; hash_bits++)
+		/* nothing */ ;
+	NR_HASH = 1<<hash_bits;
+	hash_table = (struct buffer_head **) start_buffer;
+	start_buffer = (struct buffer_head *) (hash_table + NR_HASH);
+	h = start_buffer;
     // 这段代码用于初始化缓冲区，建立空闲缓冲区块循环链表，并获取系统中缓冲块数目。
     // 操作的过程是从缓冲区高端开始划分1KB大小的缓冲块，与此同时在缓冲区低端建立
     // 描述该缓冲区块的结构buffer_head,并将这些buffer_head组成双向链表。
@@ -520,11 +791,14 @@ void buffer_init(long buffer_end)
 		h->b_dirt = 0;                      // 脏标志，即缓冲块修改标志
 		h->b_count = 0;                     // 缓冲块引用计数
 		h->b_lock = 0;                      // 缓冲块锁定标志
+		h->b_list = BUF_CLEAN;              // 空闲缓冲块都在干净LRU链表中
 		h->b_uptodate = 0;                  // 缓冲块更新标志(或称数据有效标志)
 		h->b_wait = NULL;                   // 指向等待该缓冲块解锁的进程
 		h->b_next = NULL;                   // 指向具有相同hash值的下一个缓冲头
 		h->b_prev = NULL;                   // 指向具有相同hash值的前一个缓冲头
+		h->b_reqnext = NULL;                // 指向同一请求项中的下一个缓冲头
 		h->b_data = (char *) b;             // 指向对应缓冲块数据块（1024字节）
+		h->b_own_data = (char *) b;         // 缓冲块自己的数据块(b_data可能指向虚拟盘)
 		h->b_prev_free = h-1;               // 指向链表中前一项
 		h->b_next_free = h+1;               // 指向连表中后一项
 		h++;                                // h指向下一新缓冲头位置
@@ -533,9 +807,10 @@ void buffer_init(long buffer_end)
 			b = (void *) 0xA0000;           // 让b指向地址0xA0000(640KB)处
 	}
 	h--;                                    // 让h指向最后一个有效缓冲块头
-	free_list = start_buffer;               // 让空闲链表头指向头一个缓冲快
-	free_list->b_prev_free = h;             // 链表头的b_prev_free指向前一项(即最后一项)。
-	h->b_next_free = free_list;             // h的下一项指针指向第一项，形成一个环链
+	lru_list[BUF_CLEAN] = start_buffer;     // 让干净LRU链表头指向头一个缓冲快
+	nr_lru[BUF_CLEAN] = NR_BUFFERS;         // 所有缓冲块都在干净LRU链表中
+	start_buffer->b_prev_free = h;          // 链表头的b_prev_free指向前一项(即最后一项)。
+	h->b_next_free = start_buffer;          // h的下一项指针指向第一项，形成一个环链
     // 最后初始化hash表，置表中所有指针为NULL。
 	for (i=0;i<NR_HASH;i++)
 		hash_table[i]=NULL;
@@ -526,8 +526,13 @@ restart_interp:
     // 存管理程序执行缺页处理而为新执行文件申请内存页面和设置相关表项，并且把相
     // 关执行文件页面读入内存中。如果“上次任务使用了协处理器”指向的是当前进程，
     // 则将其置空，并复位使用了协处理器的标志。
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+    // vfork()出来的子进程用的是父进程的地址空间，不能释放，而是还给父进程。
+	if (current->vfork_parent)
+		vfork_release();
+	else {
+		free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
+		free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	}
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
 	current->used_math = 0;
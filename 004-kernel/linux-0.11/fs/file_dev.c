@@ -14,6 +14,37 @@
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
+// 预读窗口的上下限(块数)
+#define MIN_READAHEAD 2
+#define MAX_READAHEAD 16
+
+//// 文件顺序预读。
+// 如果本次读操作正好从上次读操作结束的位置开始，就认为是顺序读：预读窗口加倍(在
+// MIN_READAHEAD和MAX_READAHEAD之间)，并对本次读取范围之后窗口内还没有预读过的块
+// 发出READA请求。这些请求在我们等待本次所需数据之前就发出了，因此在向用户空间复制
+// 数据时磁盘也在工作。否则就是发生了定位(seek)，关闭预读直到下一次顺序读。
+static void file_readahead(struct m_inode * inode, struct file * filp,
+	int count)
+{
+	unsigned long block, last, nr;
+
+	if (filp->f_pos != filp->f_rapos) {
+		filp->f_rawin = 0;
+		filp->f_raend = 0;
+		return;
+	}
+	filp->f_rawin = MIN(MAX(filp->f_rawin*2,MIN_READAHEAD),MAX_READAHEAD);
+    // block是本次读取范围之后的第一块，last是窗口末端(不超过文件末尾)。已预读过的块
+    // 不再重复请求。
+	block = (filp->f_pos+count-1)/BLOCK_SIZE + 1;
+	last = MIN(block+filp->f_rawin,(inode->i_size+BLOCK_SIZE-1)/BLOCK_SIZE);
+	block = MAX(block,filp->f_raend);
+	for ( ; block < last ; block++)
+		if ((nr = bmap(inode,block)))
+			bread_ahead(inode->i_dev,nr);
+	filp->f_raend = MAX(block,filp->f_raend);
+}
+
 //// 文件读函数 - 根据i节点和文件结构，读取文件中数据。
 // 由i节点我们可以知道设备号，由filp结构可以知道文件中当前读写指针位置。buf指定
 // 用户空间中缓冲区位置，count是需要读取字节数。返回值是实际读取的字节数，或出错号(小于0).
@@ -30,6 +61,7 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
     // 指针为NULL。(filp->f_pos)/BLOCK_SIZE用于计算出文件当前指针所在的数据块号。
 	if ((left=count)<=0)
 		return 0;
+	file_readahead(inode,filp,count);
 	while (left) {
 		if ((nr = bmap(inode,(filp->f_pos)/BLOCK_SIZE))) {
 			if (!(bh=bread(inode->i_dev,nr)))
@@ -45,18 +77,18 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 		chars = MIN( BLOCK_SIZE-nr , left );
 		filp->f_pos += chars;
 		left -= chars;
-        // 若上面从设备上读到了数据，则将p指向缓冲块中开始读取数据的位置，并且复制chars
-        // 字节到用户缓冲区buf中。否则往用户缓冲区中填入chars个0值字节。
+        // 若上面从设备上读到了数据，则用memcpy_tofs()把缓冲块中从nr开始的chars
+        // 个字节成批复制到用户缓冲区buf中。否则往用户缓冲区中填入chars个0值字节。
 		if (bh) {
-			char * p = nr + bh->b_data;
-			while (chars-->0)
-				put_fs_byte(*(p++),buf++);
+			memcpy_tofs(buf,nr + bh->b_data,chars);
+			buf += chars;
 			brelse(bh);
 		} else {
 			while (chars-->0)
 				put_fs_byte(0,buf++);
 		}
 	}
+	filp->f_rapos = filp->f_pos;                // 记下本次读结束的位置，供判断顺序读
     // 修改该i节点的访问时间为当前时间。返回读取的字节数，若读取字节数为0，则返回
     // 出错号。CURRENT_TIME是定义在include/linux/sched.h中的宏，用于计算UNIX时间。
     // 即从1970年1月1日0时0分0秒开始，到当前的时间，单位是秒。
@@ -85,6 +117,9 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 		pos = inode->i_size;
 	else
 		pos = filp->f_pos;
+    // 文件内容要变了，页面缓存中的该文件页面(若是执行文件)随之作废。写的过程中会睡眠，
+    // 运行该文件的任务可能又把(旧的或写了一半的)页面读入缓存，因此写完后还要再作废一次。
+	invalidate_inode_pages(inode);
     // 然后在已写入字节数i(刚开始为0)小于指定写入字节数count时，循环执行以下操作。
     // 在循环操作过程中，我们先取文件数据块号(pos/BLOCK_SIZE)在设备上对应的逻辑
     // 块号block。如果对应的逻辑块不存在就创建一块。如果得到的逻辑块号=0，则表示
@@ -116,10 +151,11 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 			inode->i_dirt = 1;
 		}
 		i += c;
-		while (c-->0)
-			*(p++) = get_fs_byte(buf++);
+		memcpy_fromfs(p,buf,c);
+		buf += c;
 		brelse(bh);
 	}
+	invalidate_inode_pages(inode);
     // 当数据已全部写入文件或者在写操作工程中发生问题时就会退出循环。此时我们更改文件修改
     // 时间为当前时间，并调整文件读写指针。如果此次操作不是在文件尾部添加数据，则把文件
     // 读写指针调整到当前读写位置pos处，并更改文件i节点的修改时间为当前时间。最后返回写入
@@ -12,8 +12,27 @@
 #include <linux/mm.h>
 #include <asm/system.h>
 
-// 内存中i节点表(NR_INODE=32)
-struct m_inode inode_table[NR_INODE]={{0,},};
+/*
+ * The in-core inodes are found through a hash table on (dev, nr), so
+ * that iget() doesn't have to look at every one of them. Unused inodes
+ * (i_count==0) are kept on a circular lru list, least recently used
+ * first: get_empty_inode() recycles from the front, iput() puts them at
+ * the back. That way an inode that was just used stays cached as long
+ * as possible. Both the table and the hash are sized by inode_init()
+ * from the amount of memory.
+ */
+// 内存中i节点表，共NR_INODE(nr_inodes)项，由inode_init()分配。
+struct m_inode * inode_table = NULL;
+int nr_inodes = 0;
+static struct m_inode ** inode_hash = NULL;
+static int inode_hash_bits = 0;
+static struct m_inode * free_inodes = NULL;     // lru链表头，最久未用的i节点
+static int nr_free_inodes = 0;
+
+// 与buffer.c中一样的乘法散列，取乘积的高inode_hash_bits位作为表项索引。
+#define _ihashfn(dev,nr) \
+((((((unsigned)(dev))<<16)^(unsigned)(nr))*0x9e3779b1U)>>(32-inode_hash_bits))
+#define ihash(dev,nr) inode_hash[_ihashfn(dev,nr)]
 
 // 读指定i节点号的i节点信息
 static void read_inode(struct m_inode * inode);
@@ -51,6 +70,108 @@ static inline void unlock_inode(struct m_inode * inode)
 	wake_up(&inode->i_wait);
 }
 
+//// 把i节点挂入hash表。i节点的i_dev和i_num必须已设置好。
+void insert_inode_hash(struct m_inode * inode)
+{
+	inode->i_next = ihash(inode->i_dev,inode->i_num);
+	ihash(inode->i_dev,inode->i_num) = inode;
+}
+
+//// 把i节点从hash表中取下(若在表中的话)。
+static void remove_inode_hash(struct m_inode * inode)
+{
+	struct m_inode ** p;
+
+	if (!inode->i_dev)
+		return;
+	for (p = &ihash(inode->i_dev,inode->i_num) ; *p ; p = &(*p)->i_next)
+		if (*p == inode) {
+			*p = inode->i_next;
+			break;
+		}
+	inode->i_next = NULL;
+}
+
+//// 在hash表中查找设备dev上的i节点nr。
+static struct m_inode * find_inode(int dev, int nr)
+{
+	struct m_inode * inode;
+
+	for (inode = ihash(dev,nr) ; inode ; inode = inode->i_next)
+		if (inode->i_dev == dev && inode->i_num == nr)
+			return inode;
+	return NULL;
+}
+
+//// 把引用计数刚变成0的i节点放入lru链表。
+// 还有效的i节点放到链表尾，以后iget()还可能用到它；i_dev为0的(空白的)i节点放到
+// 链表头，让get_empty_inode()先用它们，而不是先挤掉还有效的i节点。
+static void put_last_free(struct m_inode * inode)
+{
+	if (inode->i_prev_free)
+		panic("put_last_free: inode already free");
+	if (!free_inodes) {
+		free_inodes = inode->i_next_free = inode->i_prev_free = inode;
+	} else {
+		inode->i_next_free = free_inodes;
+		inode->i_prev_free = free_inodes->i_prev_free;
+		free_inodes->i_prev_free->i_next_free = inode;
+		free_inodes->i_prev_free = inode;
+		if (!inode->i_dev)
+			free_inodes = inode;
+	}
+	nr_free_inodes++;
+}
+
+//// 把要被使用(引用计数将变为1)的i节点从lru链表中取下。
+static void remove_free(struct m_inode * inode)
+{
+	if (!inode->i_prev_free)
+		panic("remove_free: inode not free");
+	if (inode->i_next_free == inode)
+		free_inodes = NULL;
+	else {
+		if (free_inodes == inode)
+			free_inodes = inode->i_next_free;
+		inode->i_prev_free->i_next_free = inode->i_next_free;
+		inode->i_next_free->i_prev_free = inode->i_prev_free;
+	}
+	inode->i_prev_free = inode->i_next_free = NULL;
+	nr_free_inodes--;
+}
+
+//// 清空i节点结构(引用计数不为0，不在lru链表中)。先把它从hash表中取下，并丢掉它在
+// 页面缓存中的页面，因为缓存项指向这个i节点结构，而它马上要另作他用了。
+void clear_inode(struct m_inode * inode)
+{
+	invalidate_inode_pages(inode);
+	remove_inode_hash(inode);
+	memset(inode,0,sizeof(*inode));
+}
+
+//// i节点表初始化。
+// 按内存大小(每16KB内存一个i节点，至少MIN_INODES个)在mem_start处分配i节点表，后面
+// 紧跟hash表，hash表项数是不小于i节点数一半的2的幂。所有i节点都放入lru链表。返回
+// 占用的内存字节数(按页对齐)，与rd_init()一样由main()从主内存区中扣除。
+long inode_init(long mem_start, long mem_end)
+{
+	int i;
+
+	nr_inodes = mem_end >> 14;
+	if (nr_inodes < MIN_INODES)
+		nr_inodes = MIN_INODES;
+	for (inode_hash_bits = 4 ; (1 << inode_hash_bits) < nr_inodes/2 ; inode_hash_bits++)
+		/* nothing */ ;
+	inode_table = (struct m_inode *) mem_start;
+	inode_hash = (struct m_inode **) (inode_table + nr_inodes);
+	memset(inode_table,0,nr_inodes * sizeof(struct m_inode));
+	for (i = 0 ; i < (1 << inode_hash_bits) ; i++)
+		inode_hash[i] = NULL;
+	for (i = 0 ; i < nr_inodes ; i++)
+		put_last_free(inode_table + i);
+	return ((long) (inode_hash + (1 << inode_hash_bits)) - mem_start + 4095) & ~4095;
+}
+
 //// 释放设备dev在内存i节点表中的所有i节点
 // 扫描内存中的i节点表数组，如果是指定设备使用的i节点就释放之。
 void invalidate_inodes(int dev)
@@ -62,44 +183,135 @@ void invalidate_inodes(int dev)
     // 节点。针对其中每个i节点，先等待该i节点解锁可用，再判断是否属于指定设备
     // 的i节点。如果是指定设备的i节点，则看看它是否还被使用着，即其引用计数
     // 是否不为0.若是则显示警告信息。然后释放之，即把i节点的设备号字段i_dev置0.
+    // 不在使用中的i节点同时移到lru链表头，让它们先被重用。
 	inode = 0+inode_table;                      // 指向i节点表指针数组首项
 	for(i=0 ; i<NR_INODE ; i++,inode++) {
 		wait_on_inode(inode);
 		if (inode->i_dev == dev) {
 			if (inode->i_count)
 				printk("inode in use on removed disk\n\r");
+			else
+				remove_free(inode);
+			remove_inode_hash(inode);
 			inode->i_dev = inode->i_dirt = 0;
+			if (!inode->i_count)
+				put_last_free(inode);
 		}
 	}
 }
 
+//// 取i节点在设备上所在的盘块号。
+// i节点所在的设备逻辑块号＝（启动块+超级块）+i节点位图占用的块数+逻辑块位图占用的块数
+// +（i节点号-1）/每块含有的i节点数。见read_inode()。
+static int inode_block(struct m_inode * inode)
+{
+	struct super_block * sb;
+
+	if (!(sb=get_super(inode->i_dev)))
+		panic("trying to write inode without device");
+	return 2 + sb->s_imap_blocks + sb->s_zmap_blocks +
+		(inode->i_num-1)/INODES_PER_BLOCK;
+}
+
+// 同一盘块中的i节点排序用的键值：设备号在高16位，盘块号在低16位(MINIX的块号不超过16位)。
+#define INODE_KEY(dev,block) ((((unsigned long) (dev))<<16) | (block))
+
+// sync_inodes()收集已修改i节点用的表项，一页内存放一批。
+struct sync_entry {
+	unsigned long key;
+	struct m_inode * inode;
+};
+
+#define NR_SYNC_ENTRIES (PAGE_SIZE/sizeof(struct sync_entry))
+
+/*
+ * sync_inodes() writes the dirty inodes one inode block at a time. It
+ * goes through the inode table once, collecting the dirty inodes with
+ * their (dev, block) keys into a page, a page-full at a time. A batch
+ * is sorted by key, and every block in it is then read once, gets all
+ * its dirty inodes copied in and is marked dirty once. The blocks of a
+ * batch end up on the dirty list - and get written - in disk order.
+ * Without a free page it falls back to writing the inodes one by one.
+ */
 //// 同步所有i节点
-// 把内存i节点表中所有i节点与设备上i节点作同步操作
+// 把内存i节点表中所有i节点与设备上i节点作同步操作。
 void sync_inodes(void)
 {
-	int i;
+	struct sync_entry * e, tmp;
 	struct m_inode * inode;
+	struct buffer_head * bh;
+	int i, j, k, n, gap, start, dev, block;
 
-    // 首先让内存i节点类型的指针指向i节点表首项，然后扫描整个i节点表中的节点。针对
-    // 其中每个i节点，先等待该i节点解锁可用(若目前正被上锁的话)，然后判断该i节点
-    // 是否已被修改并且不是管道节点。若是这种情况则将该i节点写入高速缓冲区中。
-    // 缓冲区管理程序buffer.c会在适当时机将他们写入盘中。
-	inode = 0+inode_table;
-	for(i=0 ; i<NR_INODE ; i++,inode++) {
-		wait_on_inode(inode);
-		if (inode->i_dirt && !inode->i_pipe)
-			write_inode(inode);
+	if (!(e = (struct sync_entry *) get_free_page())) {
+		inode = 0+inode_table;
+		for(i=0 ; i<NR_INODE ; i++,inode++) {
+			wait_on_inode(inode);
+			if (inode->i_dirt && !inode->i_pipe)
+				write_inode(inode);
+		}
+		return;
+	}
+	for (start = 0 ; start < NR_INODE ; start = i) {
+        // 从上一批结束处接着扫描i节点表，收集已修改的i节点及其键值，直到这一页装满。
+        // 管道i节点和没有设备的i节点不用写。
+		n = 0;
+		inode = start+inode_table;
+		for(i=start ; i<NR_INODE && n<NR_SYNC_ENTRIES ; i++,inode++) {
+			if (!inode->i_dirt || inode->i_pipe || !inode->i_dev)
+				continue;
+			e[n].key = INODE_KEY(inode->i_dev,inode_block(inode));
+			e[n++].inode = inode;
+		}
+        // 按键值排序(希尔排序)，同一盘块中的i节点就排在了一起。
+		for (gap = n/2 ; gap > 0 ; gap /= 2)
+			for (j = gap ; j < n ; j++) {
+				tmp = e[j];
+				for (k = j ; k >= gap && e[k-gap].key > tmp.key ; k -= gap)
+					e[k] = e[k-gap];
+				e[k] = tmp;
+			}
+        // 然后对每个盘块：读入一次，把其中所有已修改i节点的内容复制进去(复制前锁定
+        // i节点，并再检查一次，因为锁定时可能睡眠，i节点可能已被写过或另作他用)，然后
+        // 只置一次缓冲块已修改标志。缓冲区管理程序buffer.c会在适当时机将它写入盘中。
+		for (j = 0 ; j < n ; ) {
+			dev = e[j].key >> 16;
+			block = e[j].key & 0xffff;
+			if (!(bh=bread(dev,block)))
+				panic("unable to read i-node block");
+			for ( ; j < n && e[j].key == INODE_KEY(dev,block) ; j++) {
+				inode = e[j].inode;
+				lock_inode(inode);
+				if (inode->i_dev == dev && inode->i_dirt &&
+				    !inode->i_pipe && inode_block(inode) == block) {
+					((struct d_inode *)bh->b_data)
+						[(inode->i_num-1)%INODES_PER_BLOCK] =
+							*(struct d_inode *)inode;
+					inode->i_dirt=0;
+				}
+				unlock_inode(inode);
+			}
+			bh->b_dirt=1;
+			brelse(bh);
+		}
 	}
+	free_page((unsigned long) e);
 }
 
+//// 分配文件中某一逻辑块时的目标盘块号：文件中前一个盘块zone的下一块。
+// zone为0(前一块不存在)时目标为0，new_file_block()从超级块中的分配提示位置开始寻找。
+#define goal_after(zone) ((zone) ? (zone)+1 : 0)
+
 //// 文件数据块映射到盘块的处理操作。（block位图处理函数，bmap - block map）
 // 参数：inode - 文件的i节点指针；block - 文件中的数据块号；create - 创建块标志。
 // 该函数把指定的文件数据块block对应到设备上逻辑块上，并返回逻辑块号。如果创建标志
 // 置位，则在设备上对应逻辑块不存在时就申请新磁盘块，返回文件数据块block对应在设备
 // 上的逻辑块号（盘块号）。
+// 新逻辑块都尽量分配在文件前一个逻辑块之后(见goal_after())，这样顺序写出的文件在盘
+// 上是连续的，预读和合并读写请求才有效果。
 static int _bmap(struct m_inode * inode,int block,int create)
 {
 	struct buffer_head * bh;
+	unsigned short * table;
 	int i;
 
     // 首先判断参数文件数据块号block的有效性。如果块号小于0，则停机。如果块号大于
@@ -114,7 +326,8 @@ static int _bmap(struct m_inode * inode,int block,int create)
     // 字段中。然后设置i节点改变时间，置i节点已修改标志。然后返回逻辑块号。
 	if (block<7) {
 		if (create && !inode->i_zone[block])
-			if ((inode->i_zone[block]=new_block(inode->i_dev))) {
+			if ((inode->i_zone[block]=new_file_block(inode,
+			    block ? goal_after(inode->i_zone[block-1]) : 0))) {
 				inode->i_ctime=CURRENT_TIME;
 				inode->i_dirt=1;
 			}
@@ -129,7 +342,8 @@ static int _bmap(struct m_inode * inode,int block,int create)
 	block -= 7;
 	if (block<512) {
 		if (create && !inode->i_zone[7])
-			if ((inode->i_zone[7]=new_block(inode->i_dev))) {
+			if ((inode->i_zone[7]=new_file_block(inode,
+			    goal_after(inode->i_zone[6])))) {
 				inode->i_dirt=1;
 				inode->i_ctime=CURRENT_TIME;
 			}
@@ -141,10 +355,12 @@ static int _bmap(struct m_inode * inode,int block,int create)
         // 已修改标志。如果不是创建，则i就是需要映射（寻找）的逻辑块号。
 		if (!(bh = bread(inode->i_dev,inode->i_zone[7])))
 			return 0;
-		i = ((unsigned short *) (bh->b_data))[block];
+		table = (unsigned short *) bh->b_data;
+		i = table[block];
 		if (create && !i)
-			if ((i=new_block(inode->i_dev))) {
-				((unsigned short *) (bh->b_data))[block]=i;
+			if ((i=new_file_block(inode, goal_after(block ?
+			    table[block-1] : inode->i_zone[7])))) {
+				table[block]=i;
 				bh->b_dirt=1;
 			}
         // 最后释放该间接块占用的缓冲块，并返回磁盘上新申请或原有的对应block的逻辑块号。
@@ -160,7 +376,8 @@ static int _bmap(struct m_inode * inode,int block,int create)
     // 间接块，于是映射磁盘块失败，返回0退出。
 	block -= 512;
 	if (create && !inode->i_zone[8])
-		if ((inode->i_zone[8]=new_block(inode->i_dev))) {
+		if ((inode->i_zone[8]=new_file_block(inode,
+		    goal_after(inode->i_zone[7])))) {
 			inode->i_dirt=1;
 			inode->i_ctime=CURRENT_TIME;
 		}
@@ -173,10 +390,12 @@ static int _bmap(struct m_inode * inode,int block,int create)
     // 二次间接块的一级块。如果不是创建，则i就是需要映射的逻辑块号。
 	if (!(bh=bread(inode->i_dev,inode->i_zone[8])))
 		return 0;
-	i = ((unsigned short *)bh->b_data)[block>>9];
+	table = (unsigned short *) bh->b_data;
+	i = table[block>>9];
 	if (create && !i)
-		if ((i=new_block(inode->i_dev))) {
-			((unsigned short *) (bh->b_data))[block>>9]=i;
+		if ((i=new_file_block(inode, goal_after((block>>9) ?
+		    table[(block>>9)-1] : inode->i_zone[8])))) {
+			table[block>>9]=i;
 			bh->b_dirt=1;
 		}
 	brelse(bh);
@@ -186,13 +405,15 @@ static int _bmap(struct m_inode * inode,int block,int create)
 		return 0;
 	if (!(bh=bread(inode->i_dev,i)))
 		return 0;
-	i = ((unsigned short *)bh->b_data)[block&511];
+	table = (unsigned short *) bh->b_data;
+	i = table[block&511];
     // 如果是创建并且二级块的第block项中逻辑块号为0的话，则申请一磁盘块（逻辑块），作为
     // 最终存放数据信息的块。并让二级块中的第block项等于该新逻辑块块号(i)。然后置位二级块
     // 的已修改标志。
 	if (create && !i)
-		if ((i=new_block(inode->i_dev))) {
-			((unsigned short *) (bh->b_data))[block&511]=i;
+		if ((i=new_file_block(inode, goal_after((block&511) ?
+		    table[(block&511)-1] : bh->b_blocknr)))) {
+			table[block&511]=i;
 			bh->b_dirt=1;
 		}
     // 最后释放该二次间接块的二级块，返回磁盘上新申请的或原有的对应block的逻辑块号。
@@ -234,18 +455,22 @@ void iput(struct m_inode * inode)
     // 并返回。对于管道节点，inode->i_size存放这内存也地址。
 	if (inode->i_pipe) {
 		wake_up(&inode->i_wait);
+		wake_up_queue_all(&inode->i_rwait);
+		wake_up_queue_all(&inode->i_wwait);
 		if (--inode->i_count)
 			return;
 		free_page(inode->i_size);
 		inode->i_count=0;
 		inode->i_dirt=0;
 		inode->i_pipe=0;
+		put_last_free(inode);
 		return;
 	}
     // 如果i节点对应的设备号 ＝ 0，则将此节点的引用计数递减1，返回。例如用于管道操作
     // 的i节点，其i节点的设备号为0.
 	if (!inode->i_dev) {
-		inode->i_count--;
+		if (!--inode->i_count)
+			put_last_free(inode);
 		return;
 	}
     // 如果是块设备文件的i节点，此时逻辑块字段0(i_zone[0])中是设备号，则刷新该设备。
@@ -263,9 +488,16 @@ repeat:
 		inode->i_count--;
 		return;
 	}
+    // 最后一个引用就要放掉了，先释放为文件预留而没有用到的逻辑块(见fs/bitmap.c)。这
+    // 可能会睡眠，因此也要重新判断。
+	if (inode->i_prealloc_count) {
+		free_prealloc(inode);
+		goto repeat;
+	}
 	if (!inode->i_nlinks) {
 		truncate(inode);
 		free_inode(inode);
+		put_last_free(inode);
 		return;
 	}
     // 如果该i节点已做过修改，则回写更新该i节点，并等待该i节点解锁。由于这里在写i节点
@@ -278,42 +510,32 @@ repeat:
 	}
     // 程序若能执行到此，则说明该i节点的引用计数值i_count是1、链接数不为零，并且内容
     // 没有被修改过。因此此时只要把i节点引用计数递减1，返回。此时该i节点的i_count=0,
-    // 表示已释放。
+    // 表示已释放。它仍留在hash表中，并放到lru链表尾，以后iget()还可能用到它。
 	inode->i_count--;
+	put_last_free(inode);
 	return;
 }
 
 //// 从i节点表(inode_table)中获取一个空闲i节点项。
-// 寻找引用计数count为0的i节点，并将其写盘后清零，返回指针。引用计数被置1.
+// 从lru链表头(最久未用的)开始寻找引用计数count为0的i节点，并将其写盘后清零，返回
+// 指针。引用计数被置1.
 struct m_inode * get_empty_inode(void)
 {
 	struct m_inode * inode;
-	static struct m_inode * last_inode = inode_table;
 	int i;
 
 	do {
-        // 在初始化last_inode指针指向i节点表头一项后循环扫描整个i节点表。如果last_inode
-        // 已经指向i节点表的最后一项之后，则让其重新指向i节点表开始处，以继续循环寻找空闲
-        // i节点项。如果last_inode所指向的i节点的计数值为0，则说明可能找到空闲i节点项。
-        // 让inode指向该i节点。如果该i节点的已修改标志和锁定标志均为0，则我们可以使用该i
-        // 节点，于是退出for循环。
-		inode = NULL;
-		for (i = NR_INODE; i ; i--) {
-			if (++last_inode >= inode_table + NR_INODE)
-				last_inode = inode_table;
-			if (!last_inode->i_count) {
-				inode = last_inode;
-				if (!inode->i_dirt && !inode->i_lock)
-					break;
-			}
-		}
-        // 如果没有找到空闲i节点（inode=NULL）,则将i节点表打印出来供调试使用，并停机。
-		if (!inode) {
-			for (i=0 ; i<NR_INODE ; i++)
-				printk("%04x: %6d\t",inode_table[i].i_dev,
-					inode_table[i].i_num);
+        // 在lru链表中找第一个既没有被修改也没有上锁的i节点。如果都脏了或上锁了，就用
+        // 链表头一个，下面先把它写盘。lru链表中的i节点引用计数都为0.
+		inode = free_inodes;
+		for (i = nr_free_inodes ; i ; i--, inode = inode->i_next_free)
+			if (!inode->i_dirt && !inode->i_lock)
+				break;
+		if (!i)
+			inode = free_inodes;
+        // 如果没有空闲i节点（inode=NULL）,则停机。
+		if (!inode)
 			panic("No free inodes in mem");
-		}
         // 等待该i节点解锁，如果该i节点已修改标志被置位的话，则将该i节点刷新，因为刷新时
         // 可能会睡眠，因此需要再次循环等待该i节点解锁。
 		wait_on_inode(inode);
@@ -321,11 +543,12 @@ struct m_inode * get_empty_inode(void)
 			write_inode(inode);
 			wait_on_inode(inode);
 		}
-        // 如果i节点又被其他占用的话(i节点的计数值不为0了)，则重新寻找空闲i节点。否则
-        // 说明已找到符合要求的空闲i节点项。则将该i节点项内容清零，并置引用计数为1，
-        // 返回该i节点指针。
+        // 如果i节点又被其他占用的话(i节点的计数值不为0了，iget()已把它从lru链表中取下)，
+        // 则重新寻找空闲i节点。否则说明已找到符合要求的空闲i节点项。则把它从lru链表和
+        // hash表中取下，将该i节点项内容清零，并置引用计数为1，返回该i节点指针。
 	} while (inode->i_count);
-	memset(inode,0,sizeof(*inode));
+	remove_free(inode);
+	clear_inode(inode);
 	inode->i_count = 1;
 	return inode;
 }
@@ -345,6 +568,7 @@ struct m_inode * get_pipe_inode(void)
 		return NULL;
 	if (!(inode->i_size=get_free_page())) {
 		inode->i_count = 0;
+		put_last_free(inode);
 		return NULL;
 	}
     // 然后设置该i节点的引用计数为2，并复位管道头尾指针。i节点逻辑块号数组i_zone[]
@@ -359,40 +583,31 @@ struct m_inode * get_pipe_inode(void)
 //// 获得一个i节点
 // 参数：dev - 设备号； nr - i 节点号。
 // 从设备上读取指定节点号i节点到内存i节点表中，并返回该i节点指针。
-// 首先在位于高速缓冲区中的i节点表中搜寻，若找到指定节点号的i节点则在经过一些判断
-// 处理后返回该i节点指针。否则从设备dev上读取指定i节点号的i节点信息放入i节点表中，
-// 并返回该i节点指针。
+// 首先在hash表中搜寻，若找到指定节点号的i节点则在经过一些判断处理后返回该i节点指针。
+// 否则从设备dev上读取指定i节点号的i节点信息放入i节点表中，并返回该i节点指针。
 struct m_inode * iget(int dev,int nr)
 {
 	struct m_inode * inode, * empty;
 
     // 首先判断参数的有效性。若设备号是0，则表明内核代码有问题，显示出错信息并停机。
-    // 然后预先从i节点表中取一个空闲i节点备用。
 	if (!dev)
 		panic("iget with dev==0");
-	empty = get_empty_inode();
-    // 接着扫描i节点表。寻找参数指定节点号nr的i节点。并递增该节点的引用次数。如果当
-    // 前扫描i节点的设备号不等于指定的设备号或者节点号不等于指定的节点号，则继续扫描。
-	inode = inode_table;
-	while (inode < NR_INODE+inode_table) {
-		if (inode->i_dev != dev || inode->i_num != nr) {
-			inode++;
-			continue;
-		}
+	empty = NULL;
+    // 接着在hash表中寻找参数指定节点号nr的i节点。
+repeat:
+	if ((inode = find_inode(dev,nr))) {
         // 如果找到指定设备号dev和节点号nr的i节点，则等待该节点解锁。在等待该节点解
-        // 锁过程中，i节点表可能会发生变化。所以再次进行上述相同判断。如果发生了变化，
-        // 则再次重新扫描整个i节点表。
+        // 锁过程中，i节点可能被另作他用。所以再次进行上述相同判断。如果发生了变化，
+        // 则重新查找。
 		wait_on_inode(inode);
-		if (inode->i_dev != dev || inode->i_num != nr) {
-			inode = inode_table;
-			continue;
-		}
-        // 到这里表示找到相应的i节点。于是将该i节点引用计数增1.然后再做进一步检查，看它
-        // 是否是另一个文件系统的安装点。若是则寻找被安装文件系统根节点并返回。如果
-        // 该i节点的确是其他文件系统的安装点，则在超级块表中搜寻安装在此i节点的超级块。
-        // 如果没有找到，则显示出错信息，并放回本函数开始时获取的空闲节点empty，
-        // 返回该i节点指针。
-		inode->i_count++;
+		if (inode->i_dev != dev || inode->i_num != nr)
+			goto repeat;
+        // 到这里表示找到相应的i节点。于是将该i节点引用计数增1(原来为0的话把它从lru链表
+        // 中取下)。然后再做进一步检查，看它是否是另一个文件系统的安装点。若是则在超级
+        // 块表中搜寻安装在此i节点的超级块。如果没有找到，则显示出错信息，并放回本函数
+        // 中途获取的空闲节点empty(如果有的话)，返回该i节点指针。
+		if (!inode->i_count++)
+			remove_free(inode);
 		if (inode->i_mount) {
 			int i;
 
@@ -407,26 +622,32 @@ struct m_inode * iget(int dev,int nr)
 			}
             // 执行到这里表示已经找到安装到inode节点的文件系统超级块。于是将该i节点写盘
             // 放回，并从安装在次i节点上的文件系统超级块中取设备号，并令i节点号为ROOT_INO，
-            // 即为1.然后重新扫描整个i节点表，以获取该被安装文件系统的根i节点信息。
+            // 即为1.然后重新查找被安装文件系统的根i节点。
 			iput(inode);
 			dev = super_block[i].s_dev;
 			nr = ROOT_INO;
-			inode = inode_table;
-			continue;
+			goto repeat;
 		}
-        // 最终我们找到了相应的i节点。因此可以放弃本函数开始处临时申请的空闲的i节点，返回
-        // 找到的i节点指针。
+        // 最终我们找到了相应的i节点。因此可以放弃中途临时申请的空闲的i节点(如果有的话)，
+        // 返回找到的i节点指针。
 		if (empty)
 			iput(empty);
 		return inode;
 	}
-    // 如果我们在i节点表中没有找到指定的i节点，则利用前面申请的空闲i节点empty在i节点表中
-    // 建立该i节点。并从相应设备上读取该i节点信息，返回该i节点指针。
-	if (!empty)
-		return (NULL);
+    // 如果我们在i节点表中没有找到指定的i节点，才从i节点表中取一个空闲i节点。只在没找到
+    // 时才取，因为取空闲i节点会把lru链表头的那个有效i节点挤出hash表。取的时候可能会
+    // 睡眠，别的进程可能已经读入了这个i节点，因此要重新查找一次。
+	if (!empty) {
+		if (!(empty = get_empty_inode()))
+			return (NULL);
+		goto repeat;
+	}
+    // 仍然没有找到，就利用空闲i节点empty在i节点表中建立该i节点，挂入hash表。并从相应
+    // 设备上读取该i节点信息，返回该i节点指针。
 	inode=empty;
 	inode->i_dev = dev;
 	inode->i_num = nr;
+	insert_inode_hash(inode);
 	read_inode(inode);
 	return inode;
 }
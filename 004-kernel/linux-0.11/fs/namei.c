@@ -109,6 +109,182 @@ static int match(int len,const char * name,struct dir_entry * de)
 	return same;
 }
 
+/*
+ * The name cache remembers the result of looking up a name in a
+ * directory: (device, directory inode number, name) gives the inode
+ * number of the entry, or 0 if there is no such entry. Lookups in the
+ * path walk go through it (see lookup()), so that a directory is only
+ * searched the first time. '.' and '..' are never cached - '..' depends
+ * on the task's root and on mount points.
+ *
+ * Every change to a directory goes through add_entry() or clears an
+ * entry (unlink, rmdir), and these throw the name out of the cache.
+ * The cache of a device is cleared when it's unmounted or the floppy
+ * changes.
+ */
+#define NR_NAMES 128
+#define NR_NAME_HASH 64
+
+struct name_entry {
+	unsigned short n_dev;               /* 0 if the entry is unused */
+	unsigned short n_dir;
+	unsigned short n_ino;               /* 0 for a name that doesn't exist */
+	unsigned short n_len;
+	char n_name[NAME_LEN];
+	struct name_entry * n_next;         /* hash chain */
+	struct name_entry * n_prev_lru;
+	struct name_entry * n_next_lru;
+};
+
+static struct name_entry name_cache[NR_NAMES];
+static struct name_entry * name_hash[NR_NAME_HASH];
+static struct name_entry * name_lru = NULL;     // 最近用过的在前，空闲项在最后
+static unsigned long name_gen = 0;      // 每次作废名字时增1，见lookup()
+
+// 名字的hash值：对名字各字符做乘法散列，再与设备号和目录i节点号组合。
+static inline int name_hashfn(int dev, int dir, const char * name, int len)
+{
+	unsigned long h = dev ^ (dir << 4);
+
+	while (len--)
+		h = h * 31 + (unsigned char) *name++;
+	return h % NR_NAME_HASH;
+}
+
+// 把缓存项从lru链表中取下，再放到链表头(最近用过)或尾(空闲项)。name_lru指向链表
+// 头，链表是循环的，所以name_lru->n_prev_lru就是链表尾。
+static void name_lru_move(struct name_entry * n, int tail)
+{
+	if (n->n_next_lru == n)
+		name_lru = NULL;
+	else if (n->n_next_lru) {
+		if (name_lru == n)
+			name_lru = n->n_next_lru;
+		n->n_prev_lru->n_next_lru = n->n_next_lru;
+		n->n_next_lru->n_prev_lru = n->n_prev_lru;
+	}
+	if (!name_lru) {
+		name_lru = n->n_next_lru = n->n_prev_lru = n;
+		return;
+	}
+	n->n_next_lru = name_lru;
+	n->n_prev_lru = name_lru->n_prev_lru;
+	name_lru->n_prev_lru->n_next_lru = n;
+	name_lru->n_prev_lru = n;
+	if (!tail)
+		name_lru = n;
+}
+
+// 把缓存项从hash表中取下并置为空闲。
+static void remove_name(struct name_entry * n)
+{
+	struct name_entry ** p;
+
+	if (!n->n_dev)
+		return;
+	p = name_hash + name_hashfn(n->n_dev,n->n_dir,n->n_name,n->n_len);
+	for ( ; *p ; p = &(*p)->n_next)
+		if (*p == n) {
+			*p = n->n_next;
+			break;
+		}
+	n->n_dev = 0;
+	name_lru_move(n,1);
+}
+
+// 在缓存中查找目录dir中的名字name(在内核空间)。
+static struct name_entry * find_name(struct m_inode * dir,
+	const char * name, int len)
+{
+	struct name_entry * n;
+
+	n = name_hash[name_hashfn(dir->i_dev,dir->i_num,name,len)];
+	for ( ; n ; n = n->n_next)
+		if (n->n_dev == dir->i_dev && n->n_dir == dir->i_num &&
+		    n->n_len == len && !strncmp(n->n_name,name,len)) {
+			name_lru_move(n,0);
+			return n;
+		}
+	return NULL;
+}
+
+// 把目录dir中名字name的查找结果ino放入缓存，替换最久没用的缓存项。
+static void add_name(struct m_inode * dir, const char * name, int len, int ino)
+{
+	struct name_entry * n;
+	int h;
+
+	if (!name_lru) {
+		for (h = 0 ; h < NR_NAMES ; h++)
+			name_lru_move(name_cache + h,1);
+	}
+	n = name_lru->n_prev_lru;
+	remove_name(n);
+	n->n_dev = dir->i_dev;
+	n->n_dir = dir->i_num;
+	n->n_ino = ino;
+	n->n_len = len;
+	strncpy(n->n_name,name,len);
+	h = name_hashfn(n->n_dev,n->n_dir,name,len);
+	n->n_next = name_hash[h];
+	name_hash[h] = n;
+	name_lru_move(n,0);
+}
+
+// 从用户空间取名字到buf中，名字太长时截短(或在定义了NO_TRUNCATE时返回-1)。
+// 返回名字长度。
+static int get_name(char * buf, const char * name, int namelen)
+{
+	int i;
+
+#ifdef NO_TRUNCATE
+	if (namelen > NAME_LEN)
+		return -1;
+#else
+	if (namelen > NAME_LEN)
+		namelen = NAME_LEN;
+#endif
+	for (i = 0 ; i < namelen ; i++)
+		buf[i] = get_fs_byte(name+i);
+	return namelen;
+}
+
+//// 使目录dir中名字name(在用户空间)的缓存项作废。
+static void invalidate_name(struct m_inode * dir, const char * name, int namelen)
+{
+	char buf[NAME_LEN];
+	struct name_entry * n;
+
+	name_gen++;
+	if ((namelen = get_name(buf,name,namelen)) <= 0)
+		return;
+	if ((n = find_name(dir,buf,namelen)))
+		remove_name(n);
+}
+
+//// 使目录dir中所有名字的缓存项作废(目录被删除时)。
+static void invalidate_dir_names(struct m_inode * dir)
+{
+	int i;
+
+	name_gen++;
+	for (i = 0 ; i < NR_NAMES ; i++)
+		if (name_cache[i].n_dev == dir->i_dev &&
+		    name_cache[i].n_dir == dir->i_num)
+			remove_name(name_cache + i);
+}
+
+//// 使设备dev的所有名字缓存项作废。在卸载文件系统或更换软盘时调用。
+void invalidate_names(int dev)
+{
+	int i;
+
+	name_gen++;
+	for (i = 0 ; i < NR_NAMES ; i++)
+		if (name_cache[i].n_dev == dev)
+			remove_name(name_cache + i);
+}
+
 /*
  *	find_entry()
  *
@@ -316,6 +492,7 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 			for (i=0; i < NAME_LEN ; i++)
 				de->name[i]=(i<namelen)?get_fs_byte(name+i):0;
 			bh->b_dirt = 1;
+			invalidate_name(dir,name,namelen);  // 名字缓存中可能记着"不存在"
 			*res_dir = de;
 			return bh;
 		}
@@ -328,6 +505,46 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 	return NULL;
 }
 
+/*
+ *	lookup()
+ *
+ * returns the inode number of 'name' in the directory *dir, or 0 if
+ * it doesn't exist. It looks in the name cache first, and only if the
+ * name isn't there searches the directory with find_entry(), caching
+ * what it finds - also when it finds nothing.
+ */
+//// 查找目录*dir中名字name的i节点号。与find_entry()一样，*dir可能被换成另一个
+// 目录(对'..'的处理)。
+static int lookup(struct m_inode ** dir, const char * name, int namelen)
+{
+	char buf[NAME_LEN];
+	struct name_entry * n;
+	struct buffer_head * bh;
+	struct dir_entry * de;
+	unsigned long gen;
+	int len, inr;
+
+	if ((len = get_name(buf,name,namelen)) <= 0)
+		return 0;
+	if (buf[0] == '.' && (len == 1 || (len == 2 && buf[1] == '.'))) {
+		bh = find_entry(dir,name,namelen,&de);
+		inr = bh ? de->inode : 0;
+		brelse(bh);
+		return inr;
+	}
+	if ((n = find_name(*dir,buf,len)))
+		return n->n_ino;
+    // find_entry()可能睡眠，这期间别的任务可能改变了这个目录。如果有名字被作废
+    // 过(name_gen变了)，找到的结果就可能已过时，不放入缓存。
+	gen = name_gen;
+	bh = find_entry(dir,name,namelen,&de);
+	inr = bh ? de->inode : 0;
+	brelse(bh);
+	if (gen == name_gen)
+		add_name(*dir,buf,len,inr);
+	return inr;
+}
+
 /*
  *	get_dir()
  *
@@ -342,9 +559,7 @@ static struct m_inode * get_dir(const char * pathname)
 	char c;
 	const char * thisname;
 	struct m_inode * inode;
-	struct buffer_head * bh;
 	int namelen,inr,idev;
-	struct dir_entry * de;
 
     // 搜索操作会从当前任务结构中设置的根（或伪根）i节点或当前工作目录i节点
     // 开始，因此首先需要判断进程的根i节点指针和当前工作目录i节点指针是否有效。
@@ -398,13 +613,11 @@ static struct m_inode * get_dir(const char * pathname)
         // NULL退出。然后在找到的目录项中取出其i节点号inr和设备号idev，释放包含该目录
         // 项的高速缓冲块并放回该i节点。然后去节点号inr的i节点inode，并以该目录项为
         // 当前目录继续循环处理路径名中的下一目录名部分（或文件名）。
-		if (!(bh = find_entry(&inode,thisname,namelen,&de))) {
+		if (!(inr = lookup(&inode,thisname,namelen))) {
 			iput(inode);
 			return NULL;
 		}
-		inr = de->inode;                        // 当前目录名部分的i节点号
 		idev = inode->i_dev;
-		brelse(bh);
 		iput(inode);
 		if (!(inode = iget(idev,inr)))          // 取i节点内容。
 			return NULL;
@@ -457,8 +670,6 @@ struct m_inode * namei(const char * pathname)
 	const char * basename;
 	int inr,dev,namelen;
 	struct m_inode * dir;
-	struct buffer_head * bh;
-	struct dir_entry * de;
 
     // 首先查找指定路径的最顶层目录的目录名并得到其i节点，若不存在，则返回NULL退出。
     // 如果返回的最顶层名字长度是0，则表示该路径名以一个目录名为最后一项。因此我们
@@ -472,17 +683,13 @@ struct m_inode * namei(const char * pathname)
     // src/目录名的i节点。因为函数dir_namei()把不以'/'结束的最后一个名字当作一个文件名
     // 来看待，所以这里需要单独对这种情况使用寻找目录项i节点函数find_entry()进行处理。
     // 此时de中含有寻找到的目录项指针，而dir是包含该目录项的目录的i节点指针。
-	bh = find_entry(&dir,basename,namelen,&de);
-	if (!bh) {
+	if (!(inr = lookup(&dir,basename,namelen))) {
 		iput(dir);
 		return NULL;
 	}
-    // 接着取该目录项的i节点号和设备号，并释放包含该目录项的高速缓冲块并返回目录i节点。
-    // 然后取对应节点号的i节点，修改其被访问时间为当前时间，并置已修改标志。最后返回
-    // 该i节点指针。
-	inr = de->inode;
+    // 接着取目录的设备号并放回目录i节点。然后取对应节点号的i节点，修改其被访问时间为
+    // 当前时间，并置已修改标志。最后返回该i节点指针。
 	dev = dir->i_dev;
-	brelse(bh);
 	iput(dir);
 	dir=iget(dev,inr);
 	if (dir) {
@@ -542,8 +749,7 @@ int open_namei(const char * pathname, int flag, int mode,
     // 则表示没有找到对应文件名的目录项，因此只可能是创建文件操作。此时如果不是创建文件，则
     // 放回该目录的i节点，返回出错号退出。如果用户在该目录没有写的权力，则放回该目录的i节点，
     // 返回出错号退出。
-	bh = find_entry(&dir,basename,namelen,&de);
-	if (!bh) {
+	if (!(inr = lookup(&dir,basename,namelen))) {
 		if (!(flag & O_CREAT)) {
 			iput(dir);
 			return -ENOENT;
@@ -583,12 +789,10 @@ int open_namei(const char * pathname, int flag, int mode,
 		*res_inode = inode;
 		return 0;
 	}
-    // 若上面在目录中取文件名对应目录项结构的操作成功（即bh不为NULL），则说明指定打开的文件已
-    // 经存在。于是取出该目录项的i节点号和其所在设备号，并释放该高速缓冲区以及放回目录的i节点
-    // 如果此时堵在操作标志O_EXCL置位，但现在文件已经存在，则返回文件已存在出错码退出。
-	inr = de->inode;
+    // 若上面在目录中找到了文件名(inr不为0)，则说明指定打开的文件已经存在。于是取出其所在
+    // 设备号，并放回目录的i节点。如果此时堵在操作标志O_EXCL置位，但现在文件已经存在，则返回
+    // 文件已存在出错码退出。
 	dev = dir->i_dev;
-	brelse(bh);
 	iput(dir);
 	if (flag & O_EXCL)
 		return -EEXIST;
@@ -731,7 +935,7 @@ int sys_mkdir(const char * pathname, int mode)
     // 接着为该新i节点申请一用于保存目录项数据的磁盘块，用于保存目录项结构信息。并令i节
     // 点的第一个直接块指针等于该块号。如果申请失败则放回对应目录的i节点；复位新申请的i
     // 节点连接计数；放回该新的i节点，返回没有空间出错码退出。否则置该新的i节点已修改标志。
-	if (!(inode->i_zone[0]=new_block(inode->i_dev))) {
+	if (!(inode->i_zone[0]=new_block(inode->i_dev,0))) {
 		iput(dir);
 		inode->i_nlinks--;
 		iput(inode);
@@ -959,6 +1163,8 @@ int sys_rmdir(const char * name)
 	de->inode = 0;
 	bh->b_dirt = 1;
 	brelse(bh);
+	invalidate_name(dir,basename,namelen);
+	invalidate_dir_names(inode);
 	inode->i_nlinks=0;
 	inode->i_dirt=1;
     // 再将包含被删除目录名的目录的i节点连接计数减一，修改其改变时间和修改时间为当前时间，并置该
@@ -1044,10 +1250,12 @@ int sys_unlink(const char * name)
 		inode->i_nlinks=1;
 	}
     // 现在我们可以删除文件名对应的目录项了，于是将该文件名目录项中的i节点号字段置为0，
-    // 表示释放该目录项，并设置包含该目录项的缓冲块已修改标志，释放该高速缓冲块。
+    // 表示释放该目录项，并设置包含该目录项的缓冲块已修改标志，释放该高速缓冲块。名字缓存
+    // 中的这一项也随之作废。
 	de->inode = 0;
 	bh->b_dirt = 1;
 	brelse(bh);
+	invalidate_name(dir,basename,namelen);
     // 然后把文件名对应i节点的链接数减1，置已修改标志，更新改变时间为当前时间。最后放回
     // 该i节点和目录的i节点，返回0(成功)。如果是文件的最后一个链接，即i节点链接数减1后等
     // 于0，并且此时没有进程正打开该文件，那么在调用iput()放回i节点时，该文件也将被删除，
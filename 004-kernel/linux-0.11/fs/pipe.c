@@ -22,10 +22,10 @@ int read_pipe(struct m_inode * inode, char * buf, int count)
     // 节数退出。否则在该i节点上睡眠，等待信息。宏PIPE_SIZE定义在fs.h中。
 	while (count>0) {
 		while (!(size=PIPE_SIZE(*inode))) {
-			wake_up(&inode->i_wait);
+			wake_up_queue(&inode->i_wwait);
 			if (inode->i_count != 2) /* are there any writers? */
 				return read;
-			sleep_on(&inode->i_wait);
+			sleep_on_queue(&inode->i_rwait, 1);
 		}
         // 此时说明管道(缓冲区)中有数据。于是我们取管道尾指针到缓冲区末端的字
         // 节数chars。如果其大于还需要读取的字节数count，则令其等于count。如果
@@ -44,11 +44,15 @@ int read_pipe(struct m_inode * inode, char * buf, int count)
 		size = PIPE_TAIL(*inode);
 		PIPE_TAIL(*inode) += chars;
 		PIPE_TAIL(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			put_fs_byte(((char *)inode->i_size)[size++],buf++);
+		memcpy_tofs(buf,size + (char *)inode->i_size,chars);
+		buf += chars;
 	}
-    // 当此次读管道操作结束，则唤醒等待该管道的进程，并返回读取的字节数。
-	wake_up(&inode->i_wait);
+    // 当此次读管道操作结束，则唤醒一个等待空间的写管道进程。若管道中还有数据，
+    // 就再唤醒一个读管道进程接着读，然后返回读取的字节数。读写进程分别在i_rwait
+    // 和i_wwait上独占地睡眠，每次只唤醒一个，免得所有等待者一起醒来争抢。
+	wake_up_queue(&inode->i_wwait);
+	if (PIPE_SIZE(*inode))
+		wake_up_queue(&inode->i_rwait);
 	return read;
 }
 
@@ -66,12 +70,12 @@ int write_pipe(struct m_inode * inode, char * buf, int count)
     // 空间。宏PIPE_SIZE()、PIPE_HEAD()等定义在文件fs.h中。
 	while (count>0) {
 		while (!(size=(PAGE_SIZE-1)-PIPE_SIZE(*inode))) {
-			wake_up(&inode->i_wait);
+			wake_up_queue(&inode->i_rwait);
 			if (inode->i_count != 2) { /* no readers */
 				current->signal |= (1<<(SIGPIPE-1));
 				return written?written:-1;
 			}
-			sleep_on(&inode->i_wait);
+			sleep_on_queue(&inode->i_wwait, 1);
 		}
         // 程序执行到这里表示管道缓冲区中有可写空间size.于是我们管道头指针到缓冲区
         // 末端空间字节数chars。写管道操作是从管道头指针处开始写的。如果chars大于还
@@ -91,11 +95,14 @@ int write_pipe(struct m_inode * inode, char * buf, int count)
 		size = PIPE_HEAD(*inode);
 		PIPE_HEAD(*inode) += chars;
 		PIPE_HEAD(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			((char *)inode->i_size)[size++]=get_fs_byte(buf++);
+		memcpy_fromfs(size + (char *)inode->i_size,buf,chars);
+		buf += chars;
 	}
-    // 当此次写管道操作结束，则唤醒等待管道的进程，返回已写入的字节数，退出。
-	wake_up(&inode->i_wait);
+    // 当此次写管道操作结束，则唤醒一个读管道进程。若管道还有空闲空间，就再唤醒
+    // 一个写管道进程，然后返回已写入的字节数，退出。
+	wake_up_queue(&inode->i_rwait);
+	if (PIPE_SIZE(*inode) < PAGE_SIZE-1)
+		wake_up_queue(&inode->i_wwait);
 	return written;
 }
 
@@ -7,11 +7,14 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <sys/types.h>
+#include <fcntl.h>
 
 #include <linux/kernel.h>
 #include <linux/sched.h>
 #include <asm/segment.h>
 
+#define MAX_FILE_SIZE ((7+512+512*512)*BLOCK_SIZE)
+
 // 字符设备读写函数。
 extern int rw_char(int rw,int dev, char * buf, int count, off_t * pos);
 // 读管道操作函数。
@@ -150,3 +153,56 @@ int sys_write(unsigned int fd,char * buf,int count)
 	printk("(Write)inode->i_mode=%06o\n\r",inode->i_mode);
 	return -EINVAL;
 }
+
+//// 为文件预分配磁盘空间系统调用。
+// 参数fd是文件句柄，offset和len指定文件中的一段范围。函数为该范围内还没有对应逻辑块
+// 的文件数据块分配(已清零的)逻辑块，若范围超出文件末尾则把文件长度延长到范围末尾。
+// 分配时为每段缺失的块预留尽可能长的一段连续逻辑块(见fs/bitmap.c中的预留窗口)，因此
+// 在盘上有足够的连续空间时，以后顺序写入该文件不会再造成碎片。成功返回0，否则返回
+// 出错码(已经分配的块不会再被释放)。
+int sys_fallocate(unsigned int fd, off_t offset, off_t len)
+{
+	struct file * file;
+	struct m_inode * inode;
+	int block, end, zone, goal;
+
+    // 首先判断参数的有效性：文件必须是以写方式打开的常规文件，范围不能超出文件系统
+    // 能表示的最大文件长度(7个直接块、512个一次间接块和512*512个二次间接块)。
+	if (fd>=NR_OPEN || !(file=current->filp[fd]))
+		return -EBADF;
+	if ((file->f_flags & O_ACCMODE) == O_RDONLY)
+		return -EBADF;
+	inode = file->f_inode;
+	if (!S_ISREG(inode->i_mode))
+		return -EINVAL;
+	if (offset < 0 || len <= 0)
+		return -EINVAL;
+	if (offset > MAX_FILE_SIZE || len > MAX_FILE_SIZE - offset)
+		return -EFBIG;
+    // 然后逐块处理范围中的文件数据块。已有逻辑块的跳过，并把目标记为该块的下一块。遇到
+    // 缺失的块时，如果预留窗口已经用完(或者不在目标处)，就为该块及范围内其后的所有块预留
+    // 一段连续的逻辑块，再由create_block()从窗口中依次取用。
+	end = (offset + len - 1) / BLOCK_SIZE;
+	goal = (offset >= BLOCK_SIZE) ? bmap(inode,offset/BLOCK_SIZE - 1) : 0;
+	if (goal)
+		goal++;
+	for (block = offset/BLOCK_SIZE ; block <= end ; block++) {
+		if ((zone = bmap(inode,block))) {
+			goal = zone + 1;
+			continue;
+		}
+		if (!inode->i_prealloc_count || (goal && goal != inode->i_prealloc_block))
+			prealloc_blocks(inode,goal,end - block + 1);
+		if (!(zone = create_block(inode,block)))
+			return -ENOSPC;
+		goal = zone + 1;
+	}
+    // 最后，若范围超出了原来的文件末尾，则延长文件，并置i节点已修改标志和改变时间。
+	if (offset + len > inode->i_size) {
+		inode->i_size = offset + len;
+		invalidate_inode_pages(inode);
+	}
+	inode->i_ctime = CURRENT_TIME;
+	inode->i_dirt = 1;
+	return 0;
+}
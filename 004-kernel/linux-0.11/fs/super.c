@@ -232,9 +232,10 @@ static struct super_block * read_super(int dev)
     // 否则一切成功，另外，由于对申请空闲i节点的函数来讲，如果设备上所有的i节点已经全被使用
     // 则查找函数会返回0值。因此0号i节点是不能用的，所以这里将位图中第1块的最低bit位设置为1，
     // 以防止文件系统分配0号i节点。同样的道理，也将逻辑块位图的最低位设置为1.最后函数解锁该
-    // 超级块，并放回超级块指针。
+    // 超级块，并放回超级块指针。在此之前先统计位图各块中的空闲位数(见fs/bitmap.c)。
 	s->s_imap[0]->b_data[0] |= 1;
 	s->s_zmap[0]->b_data[0] |= 1;
+	count_free_bits(s);
 	free_super(s);
 	return s;
 }
@@ -288,6 +289,8 @@ int sys_umount(char * dev_name)
     // 设备上数据的同步操作，然后返回0，表示卸载成功。
 	put_super(dev);
 	sync_dev(dev);
+	invalidate_dev_pages(dev);
+	invalidate_names(dev);
 	return 0;
 }
 
@@ -64,6 +64,8 @@ void truncate(struct m_inode * inode)
     // 首先判断指定i节点的有效性，如果不是常规文件或者是目录文件，则返回
 	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
 		return;
+	invalidate_inode_pages(inode);      // 页面缓存中该文件的页面作废
+	free_prealloc(inode);               // 释放预留而未用的逻辑块
     // 然后释放i节点的7个直接逻辑块，并将这7个逻辑块项全置零。
 	for (i=0;i<7;i++)
 		if (inode->i_zone[i]) {                         // 如果块号不为0，则释放
@@ -37,6 +37,59 @@ static inline void put_fs_long(unsigned long val,unsigned long * addr)
 __asm__ ("movl %0,%%fs:%1"::"r" (val),"m" (*addr));
 }
 
+/*
+ * Bulk copies between kernel space and the user segment in %fs. The
+ * destination is brought to a long boundary with single bytes, the
+ * middle is done with 'rep movsl', and the last 0-3 bytes again with
+ * 'movsb'. The string instructions always store to %es, so tofs has
+ * to load %es from %fs; fromfs just overrides the source segment.
+ */
+static inline void memcpy_tofs(void * to, const void * from, unsigned long n)
+{
+	unsigned long head = (-(unsigned long) to) & 3;
+	int d0, d1, d2;
+
+	if (head > n)
+		head = n;
+	n -= head;
+__asm__ __volatile__("cld\n\t"
+	"push %%es\n\t"
+	"push %%fs\n\t"
+	"pop %%es\n\t"
+	"rep ; movsb\n\t"
+	"movl %6,%%ecx\n\t"
+	"shrl $2,%%ecx\n\t"
+	"rep ; movsl\n\t"
+	"movl %6,%%ecx\n\t"
+	"andl $3,%%ecx\n\t"
+	"rep ; movsb\n\t"
+	"pop %%es"
+	:"=&c" (d0),"=&D" (d1),"=&S" (d2)
+	:"0" (head),"1" (to),"2" (from),"r" (n)
+	:"memory");
+}
+
+static inline void memcpy_fromfs(void * to, const void * from, unsigned long n)
+{
+	unsigned long head = (-(unsigned long) to) & 3;
+	int d0, d1, d2;
+
+	if (head > n)
+		head = n;
+	n -= head;
+__asm__ __volatile__("cld\n\t"
+	"rep ; fs ; movsb\n\t"
+	"movl %6,%%ecx\n\t"
+	"shrl $2,%%ecx\n\t"
+	"rep ; fs ; movsl\n\t"
+	"movl %6,%%ecx\n\t"
+	"andl $3,%%ecx\n\t"
+	"rep ; fs ; movsb"
+	:"=&c" (d0),"=&D" (d1),"=&S" (d2)
+	:"0" (head),"1" (to),"2" (from),"r" (n)
+	:"memory");
+}
+
 /*
  * Someone who knows GNU asm better than I should double check the followig.
  * It seems to work, but I don't know if I'm doing something subtly wrong.
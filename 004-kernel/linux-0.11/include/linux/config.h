@@ -18,6 +18,25 @@
 /*#define KBD_FR */
 /*#define KBD_FINNISH */
 
+/*
+ * choose the i/o scheduler for the floppies and hard disks here -
+ * IOSCHED_DEADLINE for the elevator with read/write expiry times
+ * IOSCHED_ELEVATOR for the plain one-way elevator
+ * IOSCHED_NOOP for first come, first served
+ * The ram-disk always uses noop, as it has no seek times.
+ */
+#define IOSCHED_DEADLINE
+/*#define IOSCHED_ELEVATOR */
+/*#define IOSCHED_NOOP */
+
+/*
+ * define SCHED_TRACE to have the scheduler record its wake-ups, sleeps
+ * and task switches for schedtrace() (see tools/schedtrace.c). Every
+ * event reads the 8253, which is slow, so leave it off normally:
+ * schedtrace() then returns -ENOSYS.
+ */
+/*#define SCHED_TRACE */
+
 /*
  * Normally, Linux can get the drive parameters from the BIOS at
  * startup, but if this for some unfathomable reason fails, you'd
@@ -7,6 +7,8 @@
 #define _FS_H
 
 #include <sys/types.h>
+#include <sys/bstat.h>
+#include <linux/wait.h>
 
 /* devices are as follows: (same as minix, so we can use the minix
  * file system. These are major numbers.)
@@ -41,11 +43,20 @@ void buffer_init(long buffer_end);
 #define SUPER_MAGIC 0x137F
 
 #define NR_OPEN 20
-#define NR_INODE 32
+#define NR_INODE nr_inodes
+#define MIN_INODES 32
 #define NR_FILE 64
+#define PREALLOC_ZONES 8	/* zones reserved ahead of a file being written */
 #define NR_SUPER 8
-#define NR_HASH 307
+#define NR_BSTAT 16		/* devices with buffer-cache statistics */
+#define NR_HASH nr_hash
+#define MIN_HASH_BITS 6	/* the hash table has at least 64 entries */
 #define NR_BUFFERS nr_buffers
+#define BDFLUSH_INTERVAL 500	/* ticks between write-behind wake-ups */
+#define BUF_CLEAN 0		/* unused, unlocked and clean */
+#define BUF_LOCKED 1		/* unused, but i/o in progress */
+#define BUF_DIRTY 2		/* unused, needs writing out */
+#define NR_LIST 3
 #define BLOCK_SIZE 1024
 #define BLOCK_SIZE_BITS 10
 #ifndef NULL
@@ -67,17 +78,20 @@ typedef char buffer_block[BLOCK_SIZE];
 
 struct buffer_head {
 	char * b_data;			/* pointer to data block (1024 bytes) */
+	char * b_own_data;		/* own block, b_data may be in the ram-disk */
 	unsigned long b_blocknr;	/* block number */
 	unsigned short b_dev;		/* device (0 = free) */
 	unsigned char b_uptodate;
 	unsigned char b_dirt;		/* 0-clean,1-dirty */
 	unsigned char b_count;		/* users using this block */
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */
+	unsigned char b_list;		/* lru list, valid when b_count==0 */
 	struct task_struct * b_wait;
 	struct buffer_head * b_prev;
 	struct buffer_head * b_next;
-	struct buffer_head * b_prev_free;
+	struct buffer_head * b_prev_free;	/* NULL if on no lru list */
 	struct buffer_head * b_next_free;
+	struct buffer_head * b_reqnext;	/* next buffer of the same request */
 };
 
 struct d_inode {
@@ -111,6 +125,14 @@ struct m_inode {
 	unsigned char i_mount;
 	unsigned char i_seek;
 	unsigned char i_update;
+	struct wait_queue * i_rwait;	/* pipe readers waiting for data */
+	struct wait_queue * i_wwait;	/* pipe writers waiting for room */
+	struct m_inode * i_next;		/* hash chain, see iget() */
+	struct m_inode * i_prev_free;	/* NULL if on no lru list */
+	struct m_inode * i_next_free;
+	unsigned short i_prealloc_block;	/* first zone reserved for the file */
+	unsigned short i_prealloc_count;	/* zones reserved, see fs/bitmap.c */
+	unsigned short i_cached_pages;		/* pages in the page cache */
 };
 
 struct file {
@@ -119,6 +141,10 @@ struct file {
 	unsigned short f_count;
 	struct m_inode * f_inode;
 	off_t f_pos;
+/* read-ahead state, see file_read() */
+	off_t f_rapos;			/* where the last read ended */
+	unsigned long f_raend;		/* first block not yet read ahead */
+	unsigned short f_rawin;		/* window in blocks, 0 after a seek */
 };
 
 struct super_block {
@@ -133,6 +159,10 @@ struct super_block {
 /* These are only in memory */
 	struct buffer_head * s_imap[8];
 	struct buffer_head * s_zmap[8];
+	unsigned short s_ifree[I_MAP_SLOTS];	/* free bits in each imap block */
+	unsigned short s_zfree[Z_MAP_SLOTS];	/* free bits in each zmap block */
+	unsigned long s_ihint;			/* imap bit to start searching at */
+	unsigned long s_zhint;			/* zmap bit to start searching at */
 	unsigned short s_dev;
 	struct m_inode * s_isup;
 	struct m_inode * s_imount;
@@ -159,11 +189,13 @@ struct dir_entry {
 	char name[NAME_LEN];
 };
 
-extern struct m_inode inode_table[NR_INODE];
+extern struct m_inode * inode_table;
+extern int nr_inodes;
 extern struct file file_table[NR_FILE];
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head * start_buffer;
 extern int nr_buffers;
+extern int nr_hash;
 
 extern void check_disk_change(int dev);
 extern int floppy_change(unsigned int nr);
@@ -171,6 +203,9 @@ extern int ticks_to_floppy_on(unsigned int dev);
 extern void floppy_on(unsigned int dev);
 extern void floppy_off(unsigned int dev);
 extern void truncate(struct m_inode * inode);
+extern void invalidate_inode_pages(struct m_inode * inode);
+extern void invalidate_dev_pages(int dev);
+extern void invalidate_names(int dev);
 extern void sync_inodes(void);
 extern void wait_on(struct m_inode * inode);
 extern int bmap(struct m_inode * inode,int block);
@@ -181,16 +216,28 @@ extern int open_namei(const char * pathname, int flag, int mode,
 extern void iput(struct m_inode * inode);
 extern struct m_inode * iget(int dev,int nr);
 extern struct m_inode * get_empty_inode(void);
+extern void insert_inode_hash(struct m_inode * inode);
+extern void clear_inode(struct m_inode * inode);
 extern struct m_inode * get_pipe_inode(void);
 extern struct buffer_head * get_hash_table(int dev, int block);
 extern struct buffer_head * getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head * bh);
+extern int ll_rw_page(int rw, int dev, int block, char * buffer);
 extern void brelse(struct buffer_head * buf);
+extern void refile_buffer(struct buffer_head * bh);
+extern void wakeup_bdflush(void);
 extern struct buffer_head * bread(int dev,int block);
 extern void bread_page(unsigned long addr,int dev,int b[4]);
 extern struct buffer_head * breada(int dev,int block,...);
-extern int new_block(int dev);
+extern void bread_ahead(int dev,int block);
+extern struct bstat * get_bstat(int dev);
+extern char * rd_map(int dev, int block);
+extern int new_block(int dev, int goal);
 extern void free_block(int dev, int block);
+extern void count_free_bits(struct super_block * sb);
+extern int prealloc_blocks(struct m_inode * inode, int goal, int count);
+extern int new_file_block(struct m_inode * inode, int goal);
+extern void free_prealloc(struct m_inode * inode);
 extern struct m_inode * new_inode(int dev);
 extern void free_inode(struct m_inode * inode);
 extern int sync_dev(int dev);
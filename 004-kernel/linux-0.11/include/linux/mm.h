@@ -2,9 +2,13 @@
 #define _MM_H
 
 #define PAGE_SIZE 4096
+#define NR_MEM_LISTS 6		/* blocks of up to 2^5 pages (128kB) */
 
 extern unsigned long get_free_page(void);
+extern unsigned long get_free_pages(int order);
 extern unsigned long put_page(unsigned long page,unsigned long address);
 extern void free_page(unsigned long addr);
+extern void free_pages(unsigned long addr, int order);
+extern int zero_idle_page(void);
 
 #endif
@@ -10,6 +10,7 @@
 #include <linux/head.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/timer.h>
 #include <signal.h>
 
 #if (NR_OPEN > 32)
@@ -27,6 +28,8 @@
 #endif
 
 extern int copy_page_tables(unsigned long from, unsigned long to, long size);
+extern int share_page_tables(unsigned long from, unsigned long to, long size);
+extern void vfork_release(void);
 extern int free_page_tables(unsigned long from, unsigned long size);
 
 extern void sched_init(void);
@@ -106,6 +109,12 @@ struct task_struct {
 	struct desc_struct ldt[3];
 /* tss for this task */
 	struct tss_struct tss;
+/* run queue, see kernel/sched.c */
+	int nr;			/* index in task[] */
+	long epoch;		/* counter is up to date for this epoch */
+	struct task_struct * run_next;
+	struct timer_list alarm_timer;	/* sends SIGALRM at 'alarm' */
+	struct task_struct * vfork_parent;	/* sleeping in vfork() for us */
 };
 
 /*
@@ -143,10 +152,16 @@ extern long startup_time;
 
 #define CURRENT_TIME (startup_time+jiffies/HZ)
 
-extern void add_timer(long jiffies, void (*fn)(void));
+extern void set_alarm(long expires);
 extern void sleep_on(struct task_struct ** p);
 extern void interruptible_sleep_on(struct task_struct ** p);
 extern void wake_up(struct task_struct ** p);
+extern void wake_up_process(struct task_struct * p);
+extern void sleep_on_queue(struct wait_queue ** q, int exclusive);
+extern void interruptible_sleep_on_queue(struct wait_queue ** q, int exclusive);
+extern void wake_up_queue(struct wait_queue ** q);
+extern void wake_up_queue_all(struct wait_queue ** q);
+extern void signal_wake_up(struct task_struct * p);
 
 /*
  * Entry into gdt where to find first TSS. 0-nul, 1-cs, 2-ds, 3-syscall
@@ -0,0 +1,30 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+/*
+ * Kernel timers. A timer_list is normally part of a bigger structure
+ * (like the alarm timer in the task_struct): set 'expires' (absolute, in
+ * jiffies), 'function' and 'data', and start it with start_timer(). The
+ * function is called from the timer interrupt, with 'data' as argument.
+ * del_timer() cancels a pending timer and returns 1, or 0 if it had
+ * already gone off. Both may be called with interrupts off, and from
+ * the timer functions themselves.
+ */
+struct timer_list {
+	struct timer_list * next;
+	struct timer_list ** pprev;	/* NULL if not pending */
+	unsigned long expires;
+	unsigned long data;
+	void (*function)(unsigned long);
+};
+
+static inline void init_timer(struct timer_list * timer)
+{
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+extern void start_timer(struct timer_list * timer);
+extern int del_timer(struct timer_list * timer);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _WAIT_H
+#define _WAIT_H
+
+/*
+ * A wait queue is a list of these, one for each sleeping task. They
+ * live on the kernel stacks of the sleepers (see sleep_on_queue() in
+ * kernel/sched.c), and the waker takes them off the list, so a task is
+ * woken at most once per sleep.
+ *
+ * wake_up_queue() wakes every non-exclusive waiter, but only the first
+ * of the exclusive ones: those are tasks that will use up what they are
+ * waiting for (a free buffer, a request, data in a pipe), so waking more
+ * than one of them only makes the others go back to sleep again.
+ */
+struct wait_queue {
+	struct task_struct * task;	/* NULL once woken */
+	int exclusive;
+	struct wait_queue * next;
+};
+
+#endif
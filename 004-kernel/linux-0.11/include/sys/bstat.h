@@ -0,0 +1,22 @@
+#ifndef _BSTAT_H
+#define _BSTAT_H
+
+#include <sys/types.h>
+
+/*
+ * Buffer-cache statistics for one block device, as returned by
+ * bstat(). Times are in jiffies (1/100 s).
+ */
+struct bstat {
+	dev_t bs_dev;
+	unsigned long bs_hits;		/* found in the cache */
+	unsigned long bs_misses;	/* not in the cache */
+	unsigned long bs_evict;		/* buffers taken over by getblk() */
+	unsigned long bs_dirty_evict;	/* dirty buffers getblk() had to write */
+	unsigned long bs_reada_drop;	/* read-ahead requests dropped */
+	unsigned long bs_wait;		/* time spent in wait_on_buffer() */
+};
+
+extern int bstat(int index, struct bstat * buf);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef _SCHEDTRACE_H
+#define _SCHEDTRACE_H
+
+/*
+ * Scheduler events, as returned by schedtrace(). The time of an event
+ * is se_jiffies ticks plus se_clock 8253 clocks (1193180 a second) into
+ * the tick; se_clock may be more than a tick long if the machine was
+ * idle. tools/schedtrace decodes them.
+ */
+#define SE_WAKEUP	1	/* se_pid made runnable while in se_state */
+#define SE_SLEEP	2	/* se_pid going to sleep in se_state */
+#define SE_SWITCH_OUT	3	/* se_pid stops running, se_other runs next */
+#define SE_SWITCH_IN	4	/* se_pid starts running after se_other */
+#define SE_LOST		5	/* se_where events were overwritten */
+
+struct sched_event {
+	unsigned long se_jiffies;
+	unsigned long se_clock;
+	unsigned char se_type;
+	unsigned char se_state;		/* task state, 0 if preempted */
+	short se_pid;
+	short se_other;			/* WAKEUP: the task that was running */
+	short se_pad;
+	unsigned long se_where;		/* SLEEP, SWITCH_OUT: caller address */
+};
+
+extern int schedtrace(struct sched_event * buf, int count);
+
+#endif
@@ -129,6 +129,12 @@
 #define __NR_ssetmask	69
 #define __NR_setreuid	70
 #define __NR_setregid	71
+#define __NR_bdflush	72
+#define __NR_bstat	73
+#define __NR_nanosleep	74
+#define __NR_schedtrace	75
+#define __NR_vfork	76
+#define __NR_fallocate	77
 
 #define _syscall0(type,name) \
 type name(void) \
@@ -207,7 +213,9 @@ int execle(const char * pathname, char * arg0, ...);
 volatile void exit(int status);
 volatile void _exit(int status);
 int fcntl(int fildes, int cmd, ...);
+int fallocate(int fildes, off_t offset, off_t len);
 int fork(void);
+int vfork(void);
 int getpid(void);
 int getuid(void);
 int geteuid(void);
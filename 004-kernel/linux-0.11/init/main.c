@@ -45,6 +45,8 @@ static inline _syscall0(int,pause)
 static inline _syscall1(int,setup,void *,BIOS)
 // int sync()系统调用：更新文件系统。
 static inline _syscall0(int,sync)
+// int bdflush()系统调用：等待被唤醒后把已修改的缓冲块写盘，仅由写回进程使用。
+static inline _syscall0(int,bdflush)
 
 // tty头文件，定义了有关tty_io, 串行通信方面的参数、常数
 #include <linux/tty.h>
@@ -78,6 +80,8 @@ extern void floppy_init(void);
 extern void mem_init(long start, long end);
 // 虚拟盘初始化
 extern long rd_init(long mem_start, int length);
+// i节点表初始化
+extern long inode_init(long mem_start, long mem_end);
 extern long kernel_mktime(struct tm * tm);      //计算系统开始启动时间（秒）
 extern long startup_time;       // 内核启动时间（开机时间）（秒）
 
@@ -158,9 +162,11 @@ void main(void)		/* This really IS void, no error here. */
  	drive_info = DRIVE_INFO;        // 复制0x90080处的硬盘参数
 	memory_end = (1<<20) + (EXT_MEM_K<<10);     // 内存大小=1Mb + 扩展内存(k)*1024 byte
 	memory_end &= 0xfffff000;                   // 忽略不到4kb(1页)的内存数
-	if (memory_end > 16*1024*1024)              // 内存超过16Mb，则按16Mb计
-		memory_end = 16*1024*1024;
-	if (memory_end > 12*1024*1024)              // 如果内存>12Mb,则设置缓冲区末端=4Mb 
+	if (memory_end > 64*1024*1024)              // 内存超过64Mb，则按64Mb计(见mm/memory.c)
+		memory_end = 64*1024*1024;
+	if (memory_end > 32*1024*1024)              // 如果内存>32Mb,则缓冲区为内存的1/8
+		buffer_memory_end = (memory_end/8) & 0xfffff000;
+	else if (memory_end > 12*1024*1024)         // 否则若内存>12Mb,则设置缓冲区末端=4Mb 
 		buffer_memory_end = 4*1024*1024;
 	else if (memory_end > 6*1024*1024)          // 否则若内存>6Mb,则设置缓冲区末端=2Mb
 		buffer_memory_end = 2*1024*1024;
@@ -171,6 +177,8 @@ void main(void)		/* This really IS void, no error here. */
 #ifdef RAMDISK
 	main_memory_start += rd_init(main_memory_start, RAMDISK*1024);
 #endif
+    // i节点表的大小也随内存大小而定，它同样占用主内存区的开始部分(fs/inode.c)。
+	main_memory_start += inode_init(main_memory_start, memory_end);
     // 以下是内核进行所有方面的初始化工作。阅读时最好跟着调用的程序深入进去看，若实在
     // 看不下去了，就先放一放，继续看下一个初始化调用。——这是经验之谈。o(∩_∩)o 。;-)
 	mem_init(main_memory_start,memory_end); // 主内存区初始化。mm/memory.c
@@ -238,6 +246,11 @@ void init(void)
     // 和安装根文件系统设备。该函数用25行上的宏定义，对应函数是sys_setup()，在块设备
     // 子目录kernel/blk_drv/hd.c中。
 	setup((void *) &drive_info);        // drive_info结构是2个硬盘参数表
+    // 创建写回进程(任务2)。它一直循环调用bdflush()，在后台把已修改的缓冲块按块号
+    // 顺序写盘，使getblk()总能找到干净的缓冲块，而不必同步地刷新整个设备。
+	if (!fork())
+		for (;;)
+			bdflush();
     // 下面以读写访问方式打开设备"/dev/tty0",它对应终端控制台。由于这是第一次打开文件
     // 操作，因此产生的文件句柄号(文件描述符)肯定是0。该句柄是UNIX类操作系统默认的
     // 控制台标准输入句柄stdin。这里再把它以读和写的方式别人打开是为了复制产生标准输出(写)
@@ -249,7 +262,7 @@ void init(void)
 	printf("%d buffers = %d bytes buffer space\n\r",NR_BUFFERS,
 		NR_BUFFERS*BLOCK_SIZE);
 	printf("Free mem: %d bytes\n\r",memory_end-main_memory_start);
-    // 下面fork()用于创建一个子进程(任务2)。对于被创建的子进程，fork()将返回0值，对于
+    // 下面fork()用于创建一个子进程(任务3)。对于被创建的子进程，fork()将返回0值，对于
     // 原进程(父进程)则返回子进程的进程号pid。该子进程关闭了句柄0(stdin)、以只读方式打开
     // /etc/rc文件，并使用execve()函数将进程自身替换成/bin/sh程序(即shell程序)，然后
     // 执行/bin/sh程序。然后执行/bin/sh程序。所携带的参数和环境变量分别由argv_rc和envp_rc
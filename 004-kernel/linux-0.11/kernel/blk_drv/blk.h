@@ -14,11 +14,23 @@
  */
 #define NR_REQUEST	32
 
+/*
+ * With the deadline scheduler a request that has waited this many
+ * jiffies is served next, whatever the elevator thinks. Reads are
+ * waited upon, so they get the shorter expiry.
+ */
+#define READ_EXPIRE	(HZ/2)
+#define WRITE_EXPIRE	(5*HZ)
+
 /*
  * Ok, this is an expanded form so that we can use the same
  * request for paging requests when that is implemented. In
  * paging, 'bh' is NULL, and 'waiting' is used to wait for
  * read/write completion.
+ *
+ * A request may cover several adjacent blocks: the buffers are
+ * linked through b_reqnext from 'bh' to 'bhtail'. 'buffer' always
+ * points into the data of the first buffer not yet done.
  */
 struct request {
 	int dev;		/* -1 if no request */
@@ -28,7 +40,10 @@ struct request {
 	unsigned long nr_sectors;
 	char * buffer;
 	struct task_struct * waiting;
+	int * uptodate;		/* paging requests: set to the result */
 	struct buffer_head * bh;
+	struct buffer_head * bhtail;
+	unsigned long expires;	/* jiffies, for the deadline scheduler */
 	struct request * next;
 };
 
@@ -42,14 +57,40 @@ struct request {
 ((s1)->dev < (s2)->dev || ((s1)->dev == (s2)->dev && \
 (s1)->sector < (s2)->sector))))
 
+/*
+ * An i/o scheduler decides where a new request goes in the queue, and
+ * which request the driver gets next. add_fn is called with interrupts
+ * off and a non-empty queue: 'head' is the request the driver is
+ * working on, and must stay first. next_fn is called from end_request()
+ * when 'head' is done, and returns the new first request.
+ */
+struct io_scheduler {
+	char * name;
+	void (*add_fn)(struct request * head, struct request * req);
+	struct request * (*next_fn)(struct request * head);
+};
+
+extern struct io_scheduler elevator_scheduler;
+extern struct io_scheduler deadline_scheduler;
+extern struct io_scheduler noop_scheduler;
+
+/*
+ * max_sectors is the largest request the driver can handle. Drivers
+ * that walk the buffer list of a request with next_buffer() set it
+ * at init time, the others leave it 0 and get one block per request.
+ * A driver may pick its scheduler at init time, the others get the
+ * one chosen in <linux/config.h> from blk_dev_init().
+ */
 struct blk_dev_struct {
 	void (*request_fn)(void);
 	struct request * current_request;
+	unsigned long max_sectors;
+	struct io_scheduler * sched;
 };
 
 extern struct blk_dev_struct blk_dev[NR_BLK_DEV];
 extern struct request request[NR_REQUEST];
-extern struct task_struct * wait_for_request;
+extern struct wait_queue * wait_for_request[2];
 
 #ifdef MAJOR_NR
 
@@ -103,25 +144,48 @@ static inline void unlock_buffer(struct buffer_head * bh)
 	if (!bh->b_lock)
 		printk(DEVICE_NAME ": free buffer being unlocked\n");
 	bh->b_lock=0;
+	refile_buffer(bh);
 	wake_up(&bh->b_wait);
 }
 
+/*
+ * next_buffer() finishes the first buffer of a multi-block request
+ * and moves CURRENT->buffer on to the data of the next one.
+ */
+static inline void next_buffer(int uptodate)
+{
+	struct buffer_head * bh;
+
+	if (!(bh = CURRENT->bh))
+		return;
+	CURRENT->bh = bh->b_reqnext;
+	bh->b_reqnext = NULL;
+	bh->b_uptodate = uptodate;
+	unlock_buffer(bh);
+	if (CURRENT->bh)
+		CURRENT->buffer = CURRENT->bh->b_data;
+}
+
 static inline void end_request(int uptodate)
 {
 	DEVICE_OFF(CURRENT->dev);
-	if (CURRENT->bh) {
-		CURRENT->bh->b_uptodate = uptodate;
-		unlock_buffer(CURRENT->bh);
-	}
 	if (!uptodate) {
 		printk(DEVICE_NAME " I/O error\n\r");
 		printk("dev %04x, block %d\n\r",CURRENT->dev,
-			CURRENT->bh->b_blocknr);
+			CURRENT->sector>>1);
 	}
+	while (CURRENT->bh)
+		next_buffer(uptodate);
+	if (CURRENT->uptodate)
+		*CURRENT->uptodate = uptodate;
 	wake_up(&CURRENT->waiting);
-	wake_up(&wait_for_request);
 	CURRENT->dev = -1;
-	CURRENT = CURRENT->next;
+/* the last third of the requests is for reads only, and reads go first */
+	if (CURRENT >= request+(NR_REQUEST*2)/3 || wait_for_request[READ])
+		wake_up_queue(&wait_for_request[READ]);
+	else
+		wake_up_queue(&wait_for_request[WRITE]);
+	CURRENT = (blk_dev[MAJOR_NR].sched->next_fn)(CURRENT);
 }
 
 #define INIT_REQUEST \
@@ -157,12 +157,20 @@ __asm__("cld ; rep ; movsl" \
 	::"c" (BLOCK_SIZE/4),"S" ((long)(from)),"D" ((long)(to)) \
 	)
 
+/*
+ * The DMA controller can reach the first 16MB, but can't cross a 64kB
+ * boundary. Buffers and pages are aligned, so that only happens for
+ * memory above 16MB: everything else goes to the buffer directly.
+ */
+#define DMA_OK(addr) ((addr) < 0x1000000 - BLOCK_SIZE && \
+	((addr) & 0xffff) <= 0x10000 - BLOCK_SIZE)
+
 static void setup_DMA(void)
 {
 	long addr = (long) CURRENT->buffer;
 
 	cli();
-	if (addr >= 0x100000) {
+	if (!DMA_OK(addr)) {
 		addr = (long) tmp_floppy_area;
 		if (command == FD_WRITE)
 			copy_buffer(CURRENT->buffer,tmp_floppy_area);
@@ -259,7 +267,7 @@ static void rw_interrupt(void)
 		do_fd_request();
 		return;
 	}
-	if (command == FD_READ && (unsigned long)(CURRENT->buffer) >= 0x100000)
+	if (command == FD_READ && !DMA_OK((long) CURRENT->buffer))
 		copy_buffer(tmp_floppy_area,CURRENT->buffer);
 	floppy_deselect(current_drive);
 	end_request(1);
@@ -401,6 +409,18 @@ static void reset_floppy(void)
 	sti();
 }
 
+/*
+ * The timers that wait for the motor and for the drive select. They are
+ * static, as start_timer() is called from the timer interrupt (where
+ * floppy_on_interrupt() runs) and nothing may be allocated there.
+ */
+static struct timer_list motor_timer, select_timer;
+
+static void select_timeout(unsigned long unused)
+{
+	transfer();
+}
+
 static void floppy_on_interrupt(void)
 {
 /* We cannot do a floppy-select, as that might sleep. We just force it */
@@ -409,14 +429,22 @@ static void floppy_on_interrupt(void)
 		current_DOR &= 0xFC;
 		current_DOR |= current_drive;
 		outb(current_DOR,FD_DOR);
-		add_timer(2,&transfer);
+		select_timer.expires = jiffies + 2;
+		start_timer(&select_timer);
 	} else
 		transfer();
 }
 
+static void motor_timeout(unsigned long unused)
+{
+	floppy_on_interrupt();
+}
+
 void do_fd_request(void)
 {
 	unsigned int block;
+	unsigned long flags;
+	int ticks;
 
 	seek = 0;
 	if (reset) {
@@ -451,7 +479,15 @@ void do_fd_request(void)
 		command = FD_WRITE;
 	else
 		panic("do_fd_request: unknown command");
-	add_timer(ticks_to_floppy_on(current_drive),&floppy_on_interrupt);
+	if ((ticks = ticks_to_floppy_on(current_drive)) > 0) {
+		motor_timer.expires = jiffies + ticks;
+		start_timer(&motor_timer);
+		return;
+	}
+	save_flags(flags);
+	cli();
+	floppy_on_interrupt();
+	restore_flags(flags);
 }
 
 // 软盘系统初始化
@@ -463,6 +499,10 @@ void floppy_init(void)
     // 设置软盘中断门描述符。floppy_interrupt(kernel/system_call.s)是其中断处
     // 理过程。中断号为int 0x26(38),对应硬件中断请求信号IRQ6.
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;      // =do_fd_request()
+	init_timer(&motor_timer);
+	motor_timer.function = motor_timeout;
+	init_timer(&select_timer);
+	select_timer.function = select_timeout;
 	set_trap_gate(0x26,&floppy_interrupt);              // 设置陷阱门描述符
 	outb(inb_p(0x21)&~0x40,0x21);                       // 复位软盘中断请求屏蔽位
 }
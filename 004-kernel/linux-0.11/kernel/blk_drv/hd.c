@@ -33,6 +33,8 @@ inb_p(0x71); \
 /* Max read/write errors/sector */
 #define MAX_ERRORS	7
 #define MAX_HD		2
+/* Max sectors per command: the count register is 8 bits, keep it even */
+#define MAX_SECTORS	254
 
 static void recal_intr(void);
 
@@ -259,6 +261,8 @@ static void read_intr(void)
 	CURRENT->buffer += 512;
 	CURRENT->sector++;
 	if (--CURRENT->nr_sectors) {
+		if (!(CURRENT->sector & 1))
+			next_buffer(1);
 		do_hd = &read_intr;
 		return;
 	}
@@ -276,6 +280,8 @@ static void write_intr(void)
 	if (--CURRENT->nr_sectors) {
 		CURRENT->sector++;
 		CURRENT->buffer += 512;
+		if (!(CURRENT->sector & 1))
+			next_buffer(1);
 		do_hd = &write_intr;
 		port_write(HD_DATA,CURRENT->buffer,256);
 		return;
@@ -301,7 +307,8 @@ void do_hd_request(void)
 	INIT_REQUEST;
 	dev = MINOR(CURRENT->dev);
 	block = CURRENT->sector;
-	if (dev >= 5*NR_HD || block+2 > hd[dev].nr_sects) {
+	nsect = CURRENT->nr_sectors;
+	if (dev >= 5*NR_HD || block+nsect > hd[dev].nr_sects) {
 		end_request(0);
 		goto repeat;
 	}
@@ -312,7 +319,6 @@ void do_hd_request(void)
 	__asm__("divl %4":"=a" (cyl),"=d" (head):"0" (block),"1" (0),
 		"r" (hd_info[dev].head));
 	sec++;
-	nsect = CURRENT->nr_sectors;
 	if (reset) {
 		reset = 0;
 		recalibrate = 1;
@@ -350,6 +356,7 @@ void do_hd_request(void)
 void hd_init(void)
 {
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;      // do_hd_request()
+	blk_dev[MAJOR_NR].max_sectors = MAX_SECTORS;        // 允许合并相邻块的请求
 	set_intr_gate(0x2E,&hd_interrupt);
 	outb_p(inb_p(0x21)&0xfb,0x21);                      // 复位接联的主8259A int2的屏蔽位
 	outb(inb_p(0xA1)&0xbf,0xA1);                        // 复位硬盘中断请求屏蔽位(在从片上)
@@ -8,6 +8,7 @@
  * This handles all read/write requests to block devices
  */
 #include <errno.h>
+#include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <asm/system.h>
@@ -21,30 +22,112 @@
 struct request request[NR_REQUEST];
 
 /*
- * used to wait on when there are no free requests
+ * used to wait on when there are no free requests: readers and writers
+ * wait separately, as a freed request may only be usable by a read
  */
-struct task_struct * wait_for_request = NULL;
+struct wait_queue * wait_for_request[2] = { NULL, NULL };
 
 /* blk_dev_struct is:
  *	do_request-address
  *	next-request
+ *	max sectors per request (0 = don't merge)
+ *	i/o scheduler (set up by the driver or blk_dev_init)
  */
 struct blk_dev_struct blk_dev[NR_BLK_DEV] = {
-	{ NULL, NULL },		/* no_dev */
-	{ NULL, NULL },		/* dev mem */
-	{ NULL, NULL },		/* dev fd */
-	{ NULL, NULL },		/* dev hd */
-	{ NULL, NULL },		/* dev ttyx */
-	{ NULL, NULL },		/* dev tty */
-	{ NULL, NULL }		/* dev lp */
+	{ NULL, NULL, 0, NULL },		/* no_dev */
+	{ NULL, NULL, 0, NULL },		/* dev mem */
+	{ NULL, NULL, 0, NULL },		/* dev fd */
+	{ NULL, NULL, 0, NULL },		/* dev hd */
+	{ NULL, NULL, 0, NULL },		/* dev ttyx */
+	{ NULL, NULL, 0, NULL },		/* dev tty */
+	{ NULL, NULL, 0, NULL }		/* dev lp */
 };
 
+/*
+ * The one-way elevator: requests are kept sorted by IN_ORDER, and the
+ * driver just takes them one after the other.
+ */
+static void elevator_add(struct request * tmp, struct request * req)
+{
+	for ( ; tmp->next ; tmp=tmp->next)
+		if ((IN_ORDER(tmp,req) || 
+		    !IN_ORDER(tmp,tmp->next)) &&
+		    IN_ORDER(req,tmp->next))
+			break;
+	req->next=tmp->next;
+	tmp->next=req;
+}
+
+static struct request * elevator_next(struct request * head)
+{
+	return head->next;
+}
+
+/*
+ * The deadline scheduler sorts like the elevator, but when a request
+ * has passed its expiry time, the oldest such request is moved up to
+ * be served next. This keeps a read from starving behind a stream of
+ * writes to the other end of the disk.
+ */
+static struct request * deadline_next(struct request * head)
+{
+	struct request * tmp, * prev, * exp = NULL, * exp_prev = NULL;
+
+	for (prev = head ; (tmp = prev->next) ; prev = tmp) {
+		if ((long) (jiffies - tmp->expires) < 0)
+			continue;
+		if (!exp || (long) (tmp->expires - exp->expires) < 0) {
+			exp = tmp;
+			exp_prev = prev;
+		}
+	}
+	if (exp && exp_prev != head) {
+		exp_prev->next = exp->next;
+		exp->next = head->next;
+		head->next = exp;
+	}
+	return head->next;
+}
+
+/*
+ * noop: first come, first served. Used for the ram-disk, where
+ * sorting buys nothing.
+ */
+static void noop_add(struct request * tmp, struct request * req)
+{
+	while (tmp->next)
+		tmp = tmp->next;
+	req->next = NULL;
+	tmp->next = req;
+}
+
+struct io_scheduler elevator_scheduler = {
+	"elevator", elevator_add, elevator_next
+};
+
+struct io_scheduler deadline_scheduler = {
+	"deadline", elevator_add, deadline_next
+};
+
+struct io_scheduler noop_scheduler = {
+	"noop", noop_add, elevator_next
+};
+
+#if defined(IOSCHED_NOOP)
+#define DEFAULT_SCHEDULER noop_scheduler
+#elif defined(IOSCHED_ELEVATOR)
+#define DEFAULT_SCHEDULER elevator_scheduler
+#else
+#define DEFAULT_SCHEDULER deadline_scheduler
+#endif
+
 static inline void lock_buffer(struct buffer_head * bh)
 {
 	cli();
 	while (bh->b_lock)
 		sleep_on(&bh->b_wait);
 	bh->b_lock=1;
+	refile_buffer(bh);
 	sti();
 }
 
@@ -53,13 +136,15 @@ static inline void unlock_buffer(struct buffer_head * bh)
 	if (!bh->b_lock)
 		printk("ll_rw_block.c: buffer not locked\n\r");
 	bh->b_lock = 0;
+	refile_buffer(bh);
 	wake_up(&bh->b_wait);
 }
 
 /*
  * add-request adds a request to the linked list.
  * It disables interrupts so that it can muck with the
- * request-lists in peace.
+ * request-lists in peace. Where the request goes is up
+ * to the i/o scheduler of the device.
  */
 static void add_request(struct blk_dev_struct * dev, struct request * req)
 {
@@ -75,16 +160,51 @@ static void add_request(struct blk_dev_struct * dev, struct request * req)
 		(dev->request_fn)();
 		return;
 	}
-	for ( ; tmp->next ; tmp=tmp->next)
-		if ((IN_ORDER(tmp,req) || 
-		    !IN_ORDER(tmp,tmp->next)) &&
-		    IN_ORDER(req,tmp->next))
-			break;
-	req->next=tmp->next;
-	tmp->next=req;
+	(dev->sched->add_fn)(tmp,req);
 	sti();
 }
 
+/*
+ * attach_request() tries to add the buffer to a queued request for
+ * the adjacent blocks, so that the driver can do both with a single
+ * command. The first request in the list is already being worked on
+ * by the driver, so it is left alone. Returns 1 if the buffer has
+ * been taken care of.
+ */
+static int attach_request(struct blk_dev_struct * dev, int rw,
+	struct buffer_head * bh)
+{
+	struct request * req;
+	unsigned long sector = bh->b_blocknr<<1;
+
+	if (!dev->max_sectors)
+		return 0;
+	cli();
+	if ((req = dev->current_request))
+		req = req->next;
+	for ( ; req ; req = req->next) {
+		if (req->dev != bh->b_dev || req->cmd != rw || !req->bh ||
+		    req->nr_sectors+2 > dev->max_sectors)
+			continue;
+		if (req->sector+req->nr_sectors == sector) {
+			req->bhtail->b_reqnext = bh;
+			req->bhtail = bh;
+		} else if (sector+2 == req->sector) {
+			bh->b_reqnext = req->bh;
+			req->bh = bh;
+			req->buffer = bh->b_data;
+			req->sector = sector;
+		} else
+			continue;
+		req->nr_sectors += 2;
+		bh->b_dirt = 0;
+		sti();
+		return 1;
+	}
+	sti();
+	return 0;
+}
+
 static void make_request(int major,int rw, struct buffer_head * bh)
 {
 	struct request * req;
@@ -93,8 +213,11 @@ static void make_request(int major,int rw, struct buffer_head * bh)
 /* WRITEA/READA is special case - it is not really needed, so if the */
 /* buffer is locked, we just forget about it, else it's a normal read */
 	if ((rw_ahead = (rw == READA || rw == WRITEA))) {
-		if (bh->b_lock)
+		if (bh->b_lock) {
+			if (rw == READA)
+				get_bstat(bh->b_dev)->bs_reada_drop++;
 			return;
+		}
 		if (rw == READA)
 			rw = READ;
 		else
@@ -107,6 +230,9 @@ static void make_request(int major,int rw, struct buffer_head * bh)
 		unlock_buffer(bh);
 		return;
 	}
+	bh->b_reqnext = NULL;
+	if (attach_request(major+blk_dev,rw,bh))
+		return;
 repeat:
 /* we don't allow the write-requests to fill up the queue completely:
  * we want some room for reads: they take precedence. The last third
@@ -123,10 +249,12 @@ repeat:
 /* if none found, sleep on new requests: check for rw_ahead */
 	if (req < request) {
 		if (rw_ahead) {
+			if (rw == READ)
+				get_bstat(bh->b_dev)->bs_reada_drop++;
 			unlock_buffer(bh);
 			return;
 		}
-		sleep_on(&wait_for_request);
+		sleep_on_queue(&wait_for_request[rw], 1);
 		goto repeat;
 	}
 /* fill up the request-info, and add it to the queue */
@@ -137,7 +265,10 @@ repeat:
 	req->nr_sectors = 2;
 	req->buffer = bh->b_data;
 	req->waiting = NULL;
+	req->uptodate = NULL;
 	req->bh = bh;
+	req->bhtail = bh;
+	req->expires = jiffies + ((rw == READ) ? READ_EXPIRE : WRITE_EXPIRE);
 	req->next = NULL;
 	add_request(major+blk_dev,req);
 }
@@ -154,8 +285,65 @@ void ll_rw_block(int rw, struct buffer_head * bh)
 	make_request(major,rw,bh);
 }
 
+/*
+ * ll_rw_page() reads or writes a whole page (four adjacent blocks,
+ * starting at 'block') with a single request, bypassing the buffer
+ * cache. This is the 'paging' form of the request: 'bh' is NULL and
+ * we sleep on 'waiting' until the driver is done, and end_request()
+ * tells us how it went through 'uptodate'. 1 is returned if the page
+ * was transferred. Drivers that don't take requests of 8 sectors get
+ * nothing, and 0 is returned, as it is after an I/O error, so that the
+ * caller can go through the buffers instead.
+ */
+int ll_rw_page(int rw, int dev, int block, char * buffer)
+{
+	struct request * req;
+	unsigned int major;
+	int uptodate = 0;
+
+	if ((major=MAJOR(dev)) >= NR_BLK_DEV ||
+	!(blk_dev[major].request_fn)) {
+		printk("Trying to read nonexistent block-device\n\r");
+		return 0;
+	}
+	if (blk_dev[major].max_sectors < 8)
+		return 0;
+	if (rw!=READ && rw!=WRITE)
+		panic("Bad block dev command, must be R/W");
+repeat:
+	if (rw == READ)
+		req = request+NR_REQUEST;
+	else
+		req = request+((NR_REQUEST*2)/3);
+	while (--req >= request)
+		if (req->dev<0)
+			break;
+	if (req < request) {
+		sleep_on_queue(&wait_for_request[rw], 1);
+		goto repeat;
+	}
+	req->dev = dev;
+	req->cmd = rw;
+	req->errors = 0;
+	req->sector = block<<1;
+	req->nr_sectors = 8;
+	req->buffer = buffer;
+	req->waiting = current;
+	req->uptodate = &uptodate;
+	req->bh = NULL;
+	req->bhtail = NULL;
+	req->expires = jiffies + ((rw == READ) ? READ_EXPIRE : WRITE_EXPIRE);
+	req->next = NULL;
+/* set the state first: the request may be done before we get to schedule */
+	current->state = TASK_UNINTERRUPTIBLE;
+	add_request(major+blk_dev,req);
+	schedule();
+	return uptodate;
+}
+
 // 块设备初始化函数，由初始化程序main.c调用
 // 初始化请求数组，将所有请求项置为空闲（dev = -1）,有32项（NR_REQUEST = 32）
+// 并为没有自己选择I/O调度器的块设备设置config.h中选定的默认调度器。
 void blk_dev_init(void)
 {
 	int i;
@@ -164,4 +352,7 @@ void blk_dev_init(void)
 		request[i].dev = -1;
 		request[i].next = NULL;
 	}
+	for (i=0 ; i<NR_BLK_DEV ; i++)
+		if (!blk_dev[i].sched)
+			blk_dev[i].sched = &DEFAULT_SCHEDULER;
 }
@@ -32,7 +32,9 @@ void do_rd_request(void)
 		end_request(0);
 		goto repeat;
 	}
-	if (CURRENT-> cmd == WRITE) {
+	if (CURRENT->buffer == addr)
+		;	/* a buffer mapped by rd_map(): nothing to copy */
+	else if (CURRENT-> cmd == WRITE) {
 		(void ) memcpy(addr,
 			      CURRENT->buffer,
 			      len);
@@ -46,6 +48,31 @@ void do_rd_request(void)
 	goto repeat;
 }
 
+/*
+ * rd_map() is used by getblk(): the buffers of the ram-disk don't get
+ * a copy of the block, their b_data points straight into the image.
+ * Writes to such a buffer change the image at once, so writing it out
+ * is a no-op (see above). Returns NULL if the block isn't on the
+ * ram-disk.
+ *
+ * This only saves the copying, not memory: the buffer's own data block
+ * (b_own_data) stays reserved for it, and is unused while the buffer
+ * maps the image. The buffer cache takes as much memory as before.
+ *
+ * NOTE! This is not copy-on-write. The file system writes into b_data
+ * directly, and there is no hook before it does, so a buffer can't be
+ * given a private copy when it is first changed. A change is in the
+ * image before the buffer is even marked dirty: invalidate_buffers(),
+ * or throwing away a dirty buffer, does not undo it on the ram-disk.
+ */
+char * rd_map(int dev, int block)
+{
+	if (dev != 0x0101 || block < 0 ||
+	    block >= (rd_length >> BLOCK_SIZE_BITS))
+		return NULL;
+	return rd_start + (block << BLOCK_SIZE_BITS);
+}
+
 /*
  * Returns amount of memory which needs to be reserved.
  */
@@ -55,6 +82,7 @@ long rd_init(long mem_start, int length)
 	char	*cp;
 
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	blk_dev[MAJOR_NR].sched = &noop_scheduler;
 	rd_start = (char *) mem_start;
 	rd_length = length;
 	cp = rd_start;
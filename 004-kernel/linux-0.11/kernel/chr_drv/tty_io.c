@@ -118,15 +118,17 @@ void tty_intr(struct tty_struct * tty, int mask)
 	if (tty->pgrp <= 0)
 		return;
 	for (i=0;i<NR_TASKS;i++)
-		if (task[i] && task[i]->pgrp==tty->pgrp)
+		if (task[i] && task[i]->pgrp==tty->pgrp) {
 			task[i]->signal |= mask;
+			signal_wake_up(task[i]);
+		}
 }
 
 static void sleep_if_empty(struct tty_queue * queue)
 {
 	cli();
 	while (!current->signal && EMPTY(*queue))
-		interruptible_sleep_on(&queue->proc_list);
+		interruptible_sleep_on_queue(&queue->proc_list, 1);
 	sti();
 }
 
@@ -136,7 +138,7 @@ static void sleep_if_full(struct tty_queue * queue)
 		return;
 	cli();
 	while (!current->signal && LEFT(*queue)<128)
-		interruptible_sleep_on(&queue->proc_list);
+		interruptible_sleep_on_queue(&queue->proc_list, 1);
 	sti();
 }
 
@@ -227,7 +229,7 @@ void copy_to_cooked(struct tty_struct * tty)
 		}
 		PUTCH(c,tty->secondary);
 	}
-	wake_up(&tty->secondary.proc_list);
+	wake_up_queue(&tty->secondary.proc_list);
 }
 
 int tty_read(unsigned channel, char * buf, int nr)
@@ -245,7 +247,7 @@ int tty_read(unsigned channel, char * buf, int nr)
 	if (time && !minimum) {
 		minimum=1;
 		if ((flag=(!oldalarm || time+jiffies<oldalarm)))
-			current->alarm = time+jiffies;
+			set_alarm(time+jiffies);
 	}
 	if (minimum>nr)
 		minimum=nr;
@@ -275,9 +277,9 @@ int tty_read(unsigned channel, char * buf, int nr)
 		} while (nr>0 && !EMPTY(tty->secondary));
 		if (time && !L_CANON(tty)) {
 			if ((flag=(!oldalarm || time+jiffies<oldalarm)))
-				current->alarm = time+jiffies;
+				set_alarm(time+jiffies);
 			else
-				current->alarm = oldalarm;
+				set_alarm(oldalarm);
 		}
 		if (L_CANON(tty)) {
 			if (b-buf)
@@ -285,7 +287,9 @@ int tty_read(unsigned channel, char * buf, int nr)
 		} else if (b-buf >= minimum)
 			break;
 	}
-	current->alarm = oldalarm;
+	if (!EMPTY(tty->secondary))
+		wake_up_queue(&tty->secondary.proc_list);
+	set_alarm(oldalarm);
 	if (current->signal && !(b-buf))
 		return -EINTR;
 	return (b-buf);
@@ -51,9 +51,10 @@ static inline int send_sig(long sig,struct task_struct * p,int priv)
     // 如果强制发送标志置位，或者当前进程的有效用户标识符(euid)就是指定进程的euid（也
     // 即是自己），或者当前进程是超级用婚，则向进程p发送信号sig，即在进程p位图中添加该
     // 信号，否则出错退出。其中suser()定义为(current->euid==0)，用于判断是否是超级用户。
-	if (priv || (current->euid==p->euid) || suser())
+	if (priv || (current->euid==p->euid) || suser()) {
 		p->signal |= (1<<(sig-1));
-	else
+		signal_wake_up(p);
+	} else
 		return -EPERM;
 	return 0;
 }
@@ -66,8 +67,10 @@ static void kill_session(void)
     // 扫描任务指针数组，对于所有的任务(除任务0以外)，如果其会话号session等于当前进程的
     // 会话号就向它发送挂断进程信号SIGHUP。
 	while (--p > &FIRST_TASK) {
-		if (*p && (*p)->session == current->session)
+		if (*p && (*p)->session == current->session) {
 			(*p)->signal |= 1<<(SIGHUP-1);      // 发送挂断进程信号
+			signal_wake_up(*p);
+		}
 	}
 }
 
@@ -122,6 +125,7 @@ static void tell_father(int pid)
 			if (task[i]->pid != pid)
 				continue;
 			task[i]->signal |= (1<<(SIGCHLD-1));
+			signal_wake_up(task[i]);
 			return;
 		}
 /* if we don't find any fathers, we just release ourselves */
@@ -143,8 +147,13 @@ int do_exit(long code)
     // 的选择符(0x17是进城数据段的选择符)。即在取段基地址时使用该段的描述符所处地址作为
     // 参数，取段长度时使用该段的选择符作为参数。free_page_tables()函数位于mm/memory.c
     // 文件中。
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+    // vfork()出来的子进程则把借用的地址空间还给父进程并唤醒它。
+	if (current->vfork_parent)
+		vfork_release();
+	else {
+		free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
+		free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	}
     // 如果当前进程有子进程，就将子进程的father置为1(其父进程改为进程1，即init进程)。
     // 如果该子进程已经处于僵死(ZOMBIE)状态，则向进程1发送子进程中止信号SIGCHLD。
 	for (i=0 ; i<NR_TASKS ; i++)
@@ -172,6 +181,8 @@ int do_exit(long code)
     // 如果当前进程上次使用过协处理器，则将last_task_used_math置空。
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
+    // 取消尚未到期的alarm定时器，因为任务结构所在页面将被释放。
+	del_timer(&current->alarm_timer);
     // 如果当前进程是leader进程，则终止该会话的所有相关进程。
 	if (current->leader)
 		kill_session();
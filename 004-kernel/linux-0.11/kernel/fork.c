@@ -61,8 +61,11 @@ void verify_area(void * addr,int size)
 // 设置代码段和数据段基址、限长，并复制页表。由于Linux系统采用了写时复制
 // (copy on write)技术，因此这里仅为新进程设置自己的页目录表项和页表项，而
 // 没有实际为新进程分配物理内存页面。此时新进程与其父进程共享所有内存页面。
+// 父进程不是任务0时，连页表也不复制，只共享父进程的页表(share_page_tables())，
+// 等到某一方写页面或映射新页面时再复制被写的那个页表。vfork非0时子进程干脆
+// 使用父进程的地址空间，直到它execve()或exit()(见vfork_release())。
 // 操作成功返回0，否则返回出错号。
-int copy_mem(int nr,struct task_struct * p)
+int copy_mem(int nr,struct task_struct * p,int vfork)
 {
 	unsigned long old_data_base,new_data_base,data_limit;
 	unsigned long old_code_base,new_code_base,code_limit;
@@ -80,6 +83,10 @@ int copy_mem(int nr,struct task_struct * p)
 		panic("We don't support separate I&D");
 	if (data_limit < code_limit)
 		panic("Bad data_limit");
+    // vfork的子进程就在父进程的线性地址空间中运行，ldt从父进程复制而来，
+    // 不用修改。
+	if (vfork)
+		return 0;
     // 然后设置创建中的新进程在线性地址空间中的基地址等于(64MB * 其任务号)，
     // 并用该值设置新进程局部描述符表中段描述符中的基地址。接着设置新进程
     // 的页目录表项和页表项，即复制当前进程(父进程)的页目录表项和页表项。
@@ -89,11 +96,14 @@ int copy_mem(int nr,struct task_struct * p)
 	p->start_code = new_code_base;
 	set_base(p->ldt[1],new_code_base);
 	set_base(p->ldt[2],new_data_base);
-	if (copy_page_tables(old_data_base,new_data_base,data_limit)) {
-		printk("free_page_tables: from copy_mem\n");
-		free_page_tables(new_data_base,data_limit);
-		return -ENOMEM;
-	}
+	if (!old_data_base) {
+		if (copy_page_tables(old_data_base,new_data_base,data_limit)) {
+			printk("free_page_tables: from copy_mem\n");
+			free_page_tables(new_data_base,data_limit);
+			return -ENOMEM;
+		}
+	} else
+		share_page_tables(old_data_base,new_data_base,data_limit);
 	return 0;
 }
 
@@ -110,8 +120,9 @@ int copy_mem(int nr,struct task_struct * p)
 // 2. 在刚进入system_call时压入栈的段寄存器ds、es、fs和edx、ecx、ebx；
 // 3. 调用sys_call_table中sys_fork函数时压入栈的返回地址(用参数none表示)；
 // 4. 在调用copy_process()分配任务数组项号。
-int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
-		long ebx,long ecx,long edx,
+// 参数vfork非0时子进程与父进程共享地址空间(见vfork_process())。
+static int dup_process(int vfork,int nr,long ebp,long edi,long esi,long gs,
+		long none,long ebx,long ecx,long edx,
 		long fs,long es,long ds,
 		long eip,long cs,long eflags,long esp,long ss)
 {
@@ -134,15 +145,19 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
     // 接着复位新进程的信号位图、报警定时值、会话(session)领导标志leader、进程
     // 及其子进程在内核和用户态运行时间统计值，还设置进程开始运行的系统时间start_time.
 	p->state = TASK_UNINTERRUPTIBLE;
+	p->nr = nr;                     // 任务号，schedule()用它切换到该任务
+	p->run_next = NULL;
 	p->pid = last_pid;              // 新进程号。也由find_empty_process()得到。
 	p->father = current->pid;       // 设置父进程
 	p->counter = p->priority;       // 运行时间片值
 	p->signal = 0;                  // 信号位图置0
 	p->alarm = 0;                   // 报警定时值(滴答数)
+	init_timer(&p->alarm_timer);    // 父进程的alarm定时器不被继承
 	p->leader = 0;		/* process leadership doesn't inherit */
 	p->utime = p->stime = 0;        // 用户态时间和和心态运行时间
 	p->cutime = p->cstime = 0;      // 子进程用户态和和心态运行时间
 	p->start_time = jiffies;        // 进程开始运行时间(当前时间滴答数)
+	p->vfork_parent = vfork ? current : NULL;
     // 再修改任务状态段TSS数据，由于系统给任务结构p分配了1页新内存，所以(PAGE_SIZE+
     // (long)p)让esp0正好指向该页顶端。ss0:esp0用作程序在内核态执行时的栈。另外，
     // 每个任务在GDT表中都有两个段描述符，一个是任务的TSS段描述符，另一个是任务的LDT
@@ -181,7 +196,7 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
     // 接下来复制进程页表。即在线性地址空间中设置新任务代码段和数据段描述符中的基址和限长，
     // 并复制页表。如果出错(返回值不是0)，则复位任务数组中相应项并释放为该新任务分配的用于
     // 任务结构的内存页。
-	if (copy_mem(nr,p)) {
+	if (copy_mem(nr,p,vfork)) {
 		task[nr] = NULL;
 		free_page((long) p);
 		return -EAGAIN;
@@ -205,10 +220,89 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
     // CPU自动加载。最后返回新进程号。
 	set_tss_desc(gdt+(nr<<1)+FIRST_TSS_ENTRY,&(p->tss));
 	set_ldt_desc(gdt+(nr<<1)+FIRST_LDT_ENTRY,&(p->ldt));
-	p->state = TASK_RUNNING;	/* do this last, just in case */
+	wake_up_process(p);	/* do this last, just in case */
 	return last_pid;
 }
 
+// sys_fork(system_call.s)调用的复制进程函数。
+int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
+		long ebx,long ecx,long edx,
+		long fs,long es,long ds,
+		long eip,long cs,long eflags,long esp,long ss)
+{
+	return dup_process(0,nr,ebp,edi,esi,gs,none,ebx,ecx,edx,
+		fs,es,ds,eip,cs,eflags,esp,ss);
+}
+
+// sys_vfork调用的复制进程函数。
+// 子进程不复制父进程的页表，而直接在父进程的地址空间中运行，连用户栈也是
+// 同一个，因此父进程要一直睡眠，直到子进程execve()或exit()，在那里由
+// vfork_release()唤醒。对于fork()之后马上execve()的程序(比如shell)，这样
+// 省下了共享和复制页表的全部开销。
+int vfork_process(int nr,long ebp,long edi,long esi,long gs,long none,
+		long ebx,long ecx,long edx,
+		long fs,long es,long ds,
+		long eip,long cs,long eflags,long esp,long ss)
+{
+	struct task_struct * p;
+	int pid;
+
+	pid = dup_process(1,nr,ebp,edi,esi,gs,none,ebx,ecx,edx,
+		fs,es,ds,eip,cs,eflags,esp,ss);
+	if (pid < 0)
+		return pid;
+	p = task[nr];
+    // 子进程退出后其任务结构可能已被释放并重新分配，因此要同时检查pid.
+	cli();
+	while (task[nr] == p && p->pid == pid && p->vfork_parent == current) {
+		current->state = TASK_UNINTERRUPTIBLE;
+		schedule();
+	}
+	sti();
+	return pid;
+}
+
+// 子进程结束借用父进程的地址空间：在execve()释放旧页表之前，以及exit()
+// 释放页表之前调用。此后子进程有了自己的(空的)线性地址空间，页表由父进程
+// 独自使用，父进程被唤醒从vfork()返回。
+void vfork_release(void)
+{
+	struct task_struct * parent = current->vfork_parent;
+	unsigned long base;
+
+	if (!parent)
+		return;
+	current->vfork_parent = NULL;
+	base = current->nr * 0x4000000;
+	current->start_code = base;
+	set_base(current->ldt[1],base);
+	set_base(current->ldt[2],base);
+    // 重新加载fs，使新的段基址生效(copy_strings()等还要通过fs访问用户空间)。
+	__asm__("movw %%ax,%%fs"::"a" (0x17));
+	wake_up_process(parent);
+}
+
+/*
+ * sys_vfork would normally sit next to sys_fork in system_call.s, which
+ * it mirrors exactly, only calling vfork_process() instead.
+ */
+// 系统调用vfork()的处理函数。与system_call.s中的sys_fork完全相同，只是
+// 调用vfork_process()。
+__asm__(".text\n\t.align 4\n"
+	".globl sys_vfork\n"
+	"sys_vfork:\n\t"
+	"call find_empty_process\n\t"
+	"testl %eax,%eax\n\t"
+	"js 1f\n\t"
+	"push %gs\n\t"
+	"pushl %esi\n\t"
+	"pushl %edi\n\t"
+	"pushl %ebp\n\t"
+	"pushl %eax\n\t"
+	"call vfork_process\n\t"
+	"addl $20,%esp\n"
+	"1:\tret");
+
 // 为新进程取得不重复的进程号last_pid.函数返回在任务数组中的任务号(数组项)。
 int find_empty_process(void)
 {
@@ -10,6 +10,7 @@
  * call functions (type getpid(), which just extracts a field from
  * current-task
  */
+#include <linux/config.h>
 #include <linux/sched.h>
 #include <linux/kernel.h>
 #include <linux/sys.h>
@@ -19,6 +20,9 @@
 #include <asm/segment.h>
 
 #include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/schedtrace.h>
 
 // 该宏取信号nr在信号位图中对应位的二进制数值。信号编号1-32.比如信号5的位图
 // 数值等于 1 <<(5-1) = 16 = 00010000b
@@ -38,8 +42,10 @@ void show_task(int nr,struct task_struct * p)
 	printk("%d (of %d) chars free in kernel stack\n\r",i,j);
 }
 
-// 显示所有任务的任务号、进程号、进程状态和内核堆栈空闲字节数
-// NR_TASKS是系统能容纳的最大进程(任务)数量(64个)。
+extern void show_buffer_hash(void);
+
+// 显示所有任务的任务号、进程号、进程状态和内核堆栈空闲字节数，以及高速缓冲hash表
+// 的统计信息。NR_TASKS是系统能容纳的最大进程(任务)数量(64个)。
 void show_stat(void)
 {
 	int i;
@@ -47,6 +53,7 @@ void show_stat(void)
 	for (i=0;i<NR_TASKS;i++)
 		if (task[i])
 			show_task(i,task[i]);
+	show_buffer_hash();
 }
 
 // PC机8253定时芯片的输入时钟频率约为1.193180MHz. Linux内核希望定时器发出中断的频率是
@@ -123,6 +130,120 @@ void math_state_restore()
 	}
 }
 
+/*
+ * The run queues. Every runnable task, except task 0 and the one that
+ * is running, sits in one of them at the level given by its counter
+ * (NR_LEVELS-1 for anything bigger). 'bitmap' has a bit set for each
+ * level that isn't empty, so the task with the largest counter is found
+ * with a single bsrl, however many tasks there are.
+ *
+ * A task whose counter has run out goes to the 'expired' queue instead,
+ * already given the counter it would get at the next recalculation.
+ * When the active queue runs empty the two are swapped and the epoch
+ * goes up: that is the old "counter = counter/2 + priority for every
+ * task" loop. Sleeping tasks miss those steps, and catch up with them
+ * in enqueue_task() when they are woken.
+ */
+#define NR_LEVELS 32
+
+struct run_queue {
+	unsigned long bitmap;
+	struct task_struct * head[NR_LEVELS];
+	struct task_struct * tail[NR_LEVELS];
+};
+
+static struct run_queue run_queues[2];
+static struct run_queue * active = run_queues;
+static struct run_queue * expired = run_queues+1;
+static long sched_epoch = 0;
+
+#define LEVEL(c) ((c) < NR_LEVELS ? (c) : NR_LEVELS-1)
+
+// 把任务p加到运行队列rq中第level级链表的尾部。
+static inline void rq_add(struct run_queue * rq, struct task_struct * p, int level)
+{
+	p->run_next = NULL;
+	if (rq->head[level])
+		rq->tail[level]->run_next = p;
+	else
+		rq->head[level] = p;
+	rq->tail[level] = p;
+	rq->bitmap |= 1 << level;
+}
+
+// 取出运行队列rq中最高非空级别的第一个任务。队列空时返回NULL。
+static inline struct task_struct * rq_first(struct run_queue * rq)
+{
+	struct task_struct * p;
+	int level;
+
+	if (!rq->bitmap)
+		return NULL;
+	__asm__("bsrl %1,%0":"=r" (level):"rm" (rq->bitmap));
+	p = rq->head[level];
+	if (!(rq->head[level] = p->run_next))
+		rq->bitmap &= ~(1 << level);
+	p->run_next = NULL;
+	return p;
+}
+
+// 把就绪的任务p放入运行队列。调用时必须已关中断。
+// 任务睡眠期间错过的每次重新计算都补做一遍counter = counter/2 + priority，该式
+// 很快收敛，所以循环次数有限。时间片还没用完的任务进活动队列，用完了的则直接
+// 按下一轮的时间片priority放进过期队列。
+static void enqueue_task(struct task_struct * p)
+{
+	long n, c;
+
+	for (n = sched_epoch - p->epoch ; n > 0 ; n--) {
+		c = (p->counter >> 1) + p->priority;
+		if (c == p->counter)
+			break;
+		p->counter = c;
+	}
+	p->epoch = sched_epoch;
+	if (p->counter > 0) {
+		rq_add(active, p, LEVEL(p->counter));
+		return;
+	}
+	p->counter = p->priority;
+	p->epoch = sched_epoch+1;
+	rq_add(expired, p, LEVEL(p->counter));
+}
+
+#ifdef SCHED_TRACE
+static void sched_trace(int type, struct task_struct * p, long state,
+	struct task_struct * other, unsigned long where);
+#else
+#define sched_trace(type,p,state,other,where) do { } while (0)
+#endif
+
+//// 唤醒任务p：置为就绪状态并放入运行队列。
+// 当前任务不放入队列，它在schedule()里才进入队列。僵死或已就绪的任务不予理会。
+void wake_up_process(struct task_struct * p)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (p->state == TASK_INTERRUPTIBLE || p->state == TASK_UNINTERRUPTIBLE) {
+		sched_trace(SE_WAKEUP, p, p->state, current, 0);
+		p->state = TASK_RUNNING;
+		if (p != current && p != task[0])
+			enqueue_task(p);
+	}
+	restore_flags(flags);
+}
+
+//// 向任务p发送信号后调用：若p处于可中断睡眠状态并且有未被阻塞的信号，则唤醒它。
+// 这原来是由schedule()每次扫描整个任务数组完成的。
+void signal_wake_up(struct task_struct * p)
+{
+	if (p->state == TASK_INTERRUPTIBLE &&
+	    (p->signal & ~(_BLOCKABLE & p->blocked)))
+		wake_up_process(p);
+}
+
 /*
  *  'schedule()' is the scheduler function. This is GOOD CODE! There
  * probably won't be any reason to change this, as it should work well
@@ -132,71 +253,61 @@ void math_state_restore()
  *   NOTE!!  Task 0 is the 'idle' task, which gets called when no other
  * tasks can run. It can not be killed, and it cannot sleep. The 'state'
  * information in task[0] is never used.
+ *
+ * The policy is the same as it always was (largest counter first, and
+ * counter = counter/2 + priority when all have run out), but it works
+ * on the run queues above, so it no longer looks at every task.
  */
 void schedule(void)
 {
-	int i,next,c;
-	struct task_struct ** p;
-
-/* check alarm, wake up any interruptible tasks that have got a signal */
-
-    // 从任务数组中最后一个任务开始循环检测alarm。在循环时跳过空指针项。
-	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-		if (*p) {
-            // 如果设置过任务的定时值alarm，并且已经过期(alarm<jiffies)，则在
-            // 信号位图中置SIGALRM信号，即向任务发送SIGALARM信号。然后清alarm。
-            // 该信号的默认操作是终止进程。jiffies是系统从开机开始算起的滴答数(10ms/滴答)。
-			if ((*p)->alarm && (*p)->alarm < jiffies) {
-					(*p)->signal |= (1<<(SIGALRM-1));
-					(*p)->alarm = 0;
-				}
-            // 如果信号位图中除被阻塞的信号外还有其他信号，并且任务处于可中断状态，则
-            // 置任务为就绪状态。其中'~(_BLOCKABLE & (*p)->blocked)'用于忽略被阻塞的信号，但
-            // SIGKILL 和SIGSTOP不能呗阻塞。
-			if (((*p)->signal & ~(_BLOCKABLE & (*p)->blocked)) &&
-			(*p)->state==TASK_INTERRUPTIBLE)
-				(*p)->state=TASK_RUNNING;
-		}
+	struct task_struct * next;
+	unsigned long flags;
 
 /* this is the scheduler proper: */
 
-	while (1) {
-		c = -1;
-		next = 0;
-		i = NR_TASKS;
-		p = &task[NR_TASKS];
-        // 这段代码也是从任务数组的最后一个任务开始循环处理，并跳过不含任务的数组槽。比较
-        // 每个就绪状态任务的counter(任务运行时间的递减滴答计数)值，哪一个值大，运行时间还
-        // 不长，next就值向哪个的任务号。
-		while (--i) {
-			if (!*--p)
-				continue;
-			if ((*p)->state == TASK_RUNNING && (*p)->counter > c)
-				c = (*p)->counter, next = i;
-		}
-        // 如果比较得出有counter值不等于0的结果，或者系统中没有一个可运行的任务存在(此时c
-        // 仍然为-1，next=0),则退出while(1)_的循环，执行switch任务切换操作。否则就根据每个
-        // 任务的优先权值，更新每一个任务的counter值，然后回到while(1)循环。counter值的计算
-        // 方式counter＝counter/2 + priority.注意：这里计算过程不考虑进程的状态。
-		if (c) break;
-		for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-			if (*p)
-				(*p)->counter = ((*p)->counter >> 1) +
-						(*p)->priority;
+	save_flags(flags);
+	cli();
+    // 当前任务若是带着未阻塞的信号去可中断睡眠，则不让它睡。若当前任务仍是就绪
+    // 状态，则把它放回运行队列，和其他任务一起参加选择。
+	if (current->state == TASK_INTERRUPTIBLE &&
+	    (current->signal & ~(_BLOCKABLE & current->blocked)))
+		current->state = TASK_RUNNING;
+	if (current != task[0] && current->state == TASK_RUNNING)
+		enqueue_task(current);
+    // 取活动队列中counter最大的任务。若活动队列已空而过期队列中有任务，则交换两个
+    // 队列，这就相当于原来对所有任务重新计算counter。两个队列都空时运行任务0。
+	if (!(next = rq_first(active)) && expired->bitmap) {
+		struct run_queue * tmp = active;
+
+		active = expired;
+		expired = tmp;
+		sched_epoch++;
+		next = rq_first(active);
+	}
+	if (!next)
+		next = task[0];
+	if (next != current) {
+		sched_trace(SE_SWITCH_OUT, current, current->state, next,
+			(unsigned long) __builtin_return_address(0));
+		sched_trace(SE_SWITCH_IN, next, 0, current, 0);
 	}
-    // 用下面的宏把当前任务指针current指向任务号Next的任务，并切换到该任务中运行。上面Next
-    // 被初始化为0。此时任务0仅执行pause()系统调用，并又会调用本函数。
-	switch_to(next);     // 切换到Next任务并运行。
+	switch_to(next->nr);     // 切换到next任务并运行。
+	restore_flags(flags);
 }
 
 // 转换当前任务状态为可中断的等待状态，并重新调度。
 // 该系统调用将导致进程进入睡眠状态，知道收到一个信号。该信号用于终止进程或者使进程调用
 // 一个信号捕获函数。只有当捕获了一个信号，并且信号捕获处理函数返回，pause()才会返回。此时
 // pause()返回值应该是-1，并且errno被置为EINTR。这里还没有完全实现(直到0.95版)
+static void cpu_idle(void);
+
+// 任务0没有别的任务可运行时也调用pause()，这时在cpu_idle()中停机等待中断。
 int sys_pause(void)
 {
 	current->state = TASK_INTERRUPTIBLE;
 	schedule();
+	if (current == task[0])
+		cpu_idle();
 	return 0;
 }
 
@@ -222,6 +333,8 @@ void sleep_on(struct task_struct **p)
     // 不可中断的等待状态，并执行重新调度。
 	tmp = *p;
 	*p = current;
+	sched_trace(SE_SLEEP, current, TASK_UNINTERRUPTIBLE, NULL,
+		(unsigned long) __builtin_return_address(0));
 	current->state = TASK_UNINTERRUPTIBLE;
 	schedule();
     // 只有当这个等待任务被唤醒时，调度程序才又返回到这里，表示本进程已被明确的唤醒(就
@@ -234,7 +347,7 @@ void sleep_on(struct task_struct **p)
     // 进程B置位就绪状态(唤醒)。而当轮到B进程执行时，它也才可能继续执行下面的代码。若它
     // 后面还有等待的进程C，那它也会把C唤醒等。在这前面还应该添加一行：*p = tmp.
 	if (tmp)                    // 若在其前还有存在的等待的任务，则也将其置为就绪状态(唤醒).
-		tmp->state=0;
+		wake_up_process(tmp);
 }
 
 // 将当前任务置为可中断的等待状态，并放入*p指定的等待队列中。
@@ -253,6 +366,8 @@ void interruptible_sleep_on(struct task_struct **p)
     // 中断的等待状态，并执行重新调度。
 	tmp=*p;
 	*p=current;
+	sched_trace(SE_SLEEP, current, TASK_INTERRUPTIBLE, NULL,
+		(unsigned long) __builtin_return_address(0));
 repeat:	current->state = TASK_INTERRUPTIBLE;
 	schedule();
     // 只有当这个等待任务被唤醒时，程序才又会回到这里，标志进程已被明确的唤醒执行。如果等待
@@ -261,14 +376,14 @@ repeat:	current->state = TASK_INTERRUPTIBLE;
     // 队列后，又有新的任务被插入等待队列前部。因此我们先唤醒他们，而让自己仍然等等。等待这些
     // 后续进入队列的任务被唤醒执行时来唤醒本任务。于是去执行重新调度。
 	if (*p && *p != current) {
-		(**p).state=0;
+		wake_up_process(*p);
 		goto repeat;
 	}
     // 下一句代码有误：应该是 *p = tmp, 让队列头指针指向其余等待任务，否则在当前任务之前插入
     // 等待队列的任务均被抹掉了。当然同时也需要删除下面行数中同样的语句
 	*p=NULL;
 	if (tmp)
-		tmp->state=0;
+		wake_up_process(tmp);
 }
 
 // 唤醒*p指向的让任务。*p是任务等待队列头指针。由于新等待任务是插入在等待队列头指针处的，
@@ -276,11 +391,97 @@ repeat:	current->state = TASK_INTERRUPTIBLE;
 void wake_up(struct task_struct **p)
 {
 	if (p && *p) {
-		(**p).state=0;          // 置为就绪(可运行)状态TASK_RUNNING.
+		wake_up_process(*p);    // 置为就绪(可运行)状态TASK_RUNNING,并放入运行队列。
 		*p=NULL;
 	}
 }
 
+// 把当前任务加到等待队列*q的末尾，置为state状态并重新调度。exclusive表示当前任务
+// 会用掉它所等待的资源，见include/linux/wait.h。队列项就放在本任务的内核栈上。
+// 醒来时若队列项还在队列中(被信号唤醒)，就自己把它取下。where是调用者的地址，用于跟踪。
+static void sleep_on_queue_state(struct wait_queue ** q, int exclusive,
+	long state, unsigned long where)
+{
+	struct wait_queue wait, ** pp;
+	unsigned long flags;
+
+	if (!q)
+		return;
+	if (current == &(init_task.task))
+		panic("task[0] trying to sleep");
+	wait.task = current;
+	wait.exclusive = exclusive;
+	wait.next = NULL;
+	save_flags(flags);
+	cli();
+	for (pp = q ; *pp ; pp = &(*pp)->next)
+		/* nothing */ ;
+	*pp = &wait;
+	sched_trace(SE_SLEEP, current, state, NULL, where);
+	current->state = state;
+	schedule();
+	if (wait.task)
+		for (pp = q ; *pp ; pp = &(*pp)->next)
+			if (*pp == &wait) {
+				*pp = wait.next;
+				break;
+			}
+	restore_flags(flags);
+}
+
+void sleep_on_queue(struct wait_queue ** q, int exclusive)
+{
+	sleep_on_queue_state(q, exclusive, TASK_UNINTERRUPTIBLE,
+		(unsigned long) __builtin_return_address(0));
+}
+
+void interruptible_sleep_on_queue(struct wait_queue ** q, int exclusive)
+{
+	sleep_on_queue_state(q, exclusive, TASK_INTERRUPTIBLE,
+		(unsigned long) __builtin_return_address(0));
+}
+
+// 唤醒等待队列*q上的任务：all为0时唤醒所有非独占的等待者和第一个独占的等待者，
+// all为1时全部唤醒。被唤醒的队列项从队列中取下。
+static void __wake_up_queue(struct wait_queue ** q, int all)
+{
+	struct wait_queue ** pp, * w;
+	struct task_struct * p;
+	unsigned long flags;
+	int exclusive_done = 0;
+
+	if (!q)
+		return;
+	save_flags(flags);
+	cli();
+	for (pp = q ; (w = *pp) ; ) {
+		if (w->exclusive && !all) {
+			if (exclusive_done) {
+				pp = &w->next;
+				continue;
+			}
+			/* one already woken by a signal doesn't count */
+			if (w->task->state != TASK_RUNNING)
+				exclusive_done = 1;
+		}
+		*pp = w->next;
+		p = w->task;
+		w->task = NULL;
+		wake_up_process(p);
+	}
+	restore_flags(flags);
+}
+
+void wake_up_queue(struct wait_queue ** q)
+{
+	__wake_up_queue(q, 0);
+}
+
+void wake_up_queue_all(struct wait_queue ** q)
+{
+	__wake_up_queue(q, 1);
+}
+
 /*
  * OK, here are some floppy things that shouldn't be in the kernel
  * proper. They are here because the floppy needs a timer, and this
@@ -379,63 +580,483 @@ void do_floppy_timer(void)
 	}
 }
 
-// 下面是关于定时器的代码，最多可有64个定时器。
-#define TIME_REQUESTS 64
+/*
+ * The timers live in a timing wheel of five levels, as in the picture
+ * below. tv1 has a slot for each of the next 256 jiffies; each slot of
+ * tvn[0] covers 256 jiffies, each one of tvn[1] 64 times that, etc.
+ * Adding or removing a timer is O(1). When tv1 has gone round once, the
+ * next slot of tvn[0] is emptied and its timers are put back where they
+ * belong now ("cascading"), and so on up the levels.
+ *
+ *	tv1:	 8 bits		jiffies       0 ..      255 ahead
+ *	tvn[0]:	 6 bits		jiffies     256 ..    16383 ahead
+ *	tvn[1]:	 6 bits		jiffies   16384 ..  1048575 ahead
+ *	tvn[2]:	 6 bits		jiffies 1048576 .. 67108863 ahead
+ *	tvn[3]:	 6 bits		anything further away
+ */
+#define TVR_BITS 8
+#define TVN_BITS 6
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+
+static struct timer_list * tv1[TVR_SIZE];
+static struct timer_list * tvn[4][TVN_SIZE];
+static unsigned long timer_jiffies = 0;     // 时间轮已处理到的滴答数
+
+// 把定时器放进时间轮中它所属的槽。调用时必须已关中断。
+// 已经过期的定时器放入当前槽，在下一个滴答处理。
+static void internal_add_timer(struct timer_list * timer)
+{
+	unsigned long expires = timer->expires;
+	unsigned long idx = expires - timer_jiffies;
+	struct timer_list ** vec;
+	int i;
+
+	if ((long) idx < 0)
+		vec = tv1 + (timer_jiffies & TVR_MASK);
+	else if (idx < TVR_SIZE)
+		vec = tv1 + (expires & TVR_MASK);
+	else {
+		for (i = 0 ; i < 3 ; i++)
+			if (idx < 1UL << (TVR_BITS + (i+1)*TVN_BITS))
+				break;
+		vec = tvn[i] + ((expires >> (TVR_BITS + i*TVN_BITS)) & TVN_MASK);
+	}
+	if ((timer->next = *vec))
+		(*vec)->pprev = &timer->next;
+	*vec = timer;
+	timer->pprev = vec;
+}
+
+// 把定时器从所在的槽中取下。调用时必须已关中断。
+static inline void detach_timer(struct timer_list * timer)
+{
+	if ((*timer->pprev = timer->next))
+		timer->next->pprev = timer->pprev;
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+//// 启动定时器。若它已在等待中，则按新的expires重新放置。
+void start_timer(struct timer_list * timer)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (timer->pprev)
+		detach_timer(timer);
+	internal_add_timer(timer);
+	restore_flags(flags);
+}
+
+//// 取消定时器。若定时器尚未到期返回1，否则返回0。
+int del_timer(struct timer_list * timer)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	save_flags(flags);
+	cli();
+	if (timer->pprev) {
+		detach_timer(timer);
+		ret = 1;
+	}
+	restore_flags(flags);
+	return ret;
+}
+
+// 把第i级时间轮的当前槽中的定时器重新放置到它们现在应在的位置，返回该槽号。
+// 槽号为0说明这一级也转完了一圈，需要接着处理上一级。
+static int cascade(int i)
+{
+	int idx = (timer_jiffies >> (TVR_BITS + i*TVN_BITS)) & TVN_MASK;
+	struct timer_list * timer, * next;
+
+	timer = tvn[i][idx];
+	tvn[i][idx] = NULL;
+	for ( ; timer ; timer = next) {
+		next = timer->next;
+		internal_add_timer(timer);
+	}
+	return idx;
+}
+
+// 处理到当前滴答为止所有到期的定时器。由do_timer()在时钟中断中调用。
+static void run_timers(void)
+{
+	struct timer_list * timer;
+	int i, idx;
 
-// 定时器链表结构和定时器数组。该定时器链表专用于供软驱关闭马达和启动马达定时操作。
-// 这种类型定时器类似现代Linux系统中的动态定时器(Dynamic Timer)，仅供内核使用。
-static struct timer_list {
-	long jiffies;                   // 定时滴答数
-	void (*fn)();                   // 定时处理程序
-	struct timer_list * next;       // 链接指向下一个定时器
-} timer_list[TIME_REQUESTS], * next_timer = NULL;   // next_timer是定时器队列头指针
+	while ((long) (jiffies - timer_jiffies) >= 0) {
+		idx = timer_jiffies & TVR_MASK;
+		if (!idx)
+			for (i = 0 ; i < 4 && !cascade(i) ; i++)
+				/* nothing */ ;
+		while ((timer = tv1[idx])) {
+			detach_timer(timer);
+			(timer->function)(timer->data);
+		}
+		timer_jiffies++;
+	}
+}
 
-// 添加定时器。输入参数为指定的定时值(滴答数)和相应的处理程序指针。
-// 软盘驱动程序(floppy.c)利用该函数执行启动或关闭马达的延时操作。
-// 参数jiffies - 以10毫秒计的滴答数：*fn() - 定时时间到时执行的函数
-void add_timer(long jiffies, void (*fn)(void))
+//// 任务的alarm定时器到期：向任务发送SIGALRM信号并清alarm。
+static void alarm_timeout(unsigned long data)
 {
-	struct timer_list * p;
+	struct task_struct * p = (struct task_struct *) data;
+
+	p->signal |= (1<<(SIGALRM-1));
+	p->alarm = 0;
+	signal_wake_up(p);
+}
 
-    // 如果定时处理程序指针为空，则退出
-	if (!fn)
+//// 设置当前任务的alarm到期时刻(滴答数，0表示取消)，并相应地启动或取消其定时器。
+void set_alarm(long expires)
+{
+	del_timer(&current->alarm_timer);
+	current->alarm = expires;
+	if (!expires)
 		return;
+	current->alarm_timer.expires = expires;
+	current->alarm_timer.data = (unsigned long) current;
+	current->alarm_timer.function = alarm_timeout;
+	start_timer(&current->alarm_timer);
+}
+
+/*
+ * The 8253 runs in mode 2 (rate generator), so that its count can be
+ * read back: the current period started 'pit_base' clocks into the tick
+ * and is 'pit_reload' clocks long. Normally that is 0 and LATCH, but
+ * the period may be cut into pieces to get an interrupt in the middle
+ * of a tick (for nanosleep), or stretched over several ticks when the
+ * machine is idle. do_timer() sorts out which kind of interrupt it got.
+ */
+#define SPLIT_MIN 100                       // 最短的分段(约84微秒)
+#define MAX_IDLE_TICKS (0xffff/LATCH)       // 计数器16位，最多跳过5个滴答
+
+static unsigned long pit_base = 0;
+static unsigned long pit_reload = LATCH;
+
+// 从'base'处开始一段长为'count'个时钟的计数周期。调用时必须已关中断。
+static void pit_program(unsigned long base, unsigned long count)
+{
+	pit_base = base;
+	pit_reload = count;
+	outb_p(0x34,0x43);		/* binary, mode 2, LSB/MSB, ch 0 */
+	outb_p(count & 0xff,0x40);
+	outb(count >> 8,0x40);
+}
+
+// 返回当前滴答已经过去的时钟数。空闲时可能超过LATCH。调用时必须已关中断。
+static unsigned long pit_elapsed(void)
+{
+	unsigned long count;
+
+	outb_p(0x00,0x43);		/* latch ch 0 */
+	count = inb_p(0x40);
+	count |= inb_p(0x40) << 8;
+	if (count > pit_reload)
+		count = pit_reload;
+	return pit_base + pit_reload - count;
+}
+
+/*
+ * The scheduler trace: a ring of the last NR_SCHED_EVENTS wake-ups,
+ * sleeps and task switches, drained by schedtrace(). When it is full
+ * the oldest events are overwritten, and the reader is told how many
+ * it missed. See include/sys/schedtrace.h. It is only there if
+ * SCHED_TRACE is defined in <linux/config.h>.
+ */
+#ifdef SCHED_TRACE
+#define NR_SCHED_EVENTS 512                 // 必须是2的幂
+
+static struct sched_event sched_events[NR_SCHED_EVENTS];
+static unsigned long se_head = 0;           // 下一个事件写入的位置(不回绕的计数)
+static unsigned long se_tail = 0;           // 下一个被读出的事件
+static unsigned long se_lost = 0;           // 被覆盖而未读出的事件数
+
+// 记录一个调度事件，时间为当前的jiffies加上滴答内已过去的8253时钟数。
+static void sched_trace(int type, struct task_struct * p, long state,
+	struct task_struct * other, unsigned long where)
+{
+	struct sched_event * e;
+	unsigned long flags;
+
+	save_flags(flags);
 	cli();
-    // 如果定时值 <= 0,则立刻调用其处理程序。并且该定时器不加入链表中。
-	if (jiffies <= 0)
-		(fn)();
+	if (se_head - se_tail == NR_SCHED_EVENTS) {
+		se_tail++;
+		se_lost++;
+	}
+	e = sched_events + (se_head++ & (NR_SCHED_EVENTS-1));
+	e->se_jiffies = jiffies;
+	e->se_clock = pit_elapsed();
+	e->se_type = type;
+	e->se_state = state;
+	e->se_pid = p->pid;
+	e->se_other = other ? other->pid : -1;
+	e->se_pad = 0;
+	e->se_where = where;
+	restore_flags(flags);
+}
+
+//// 系统调用schedtrace：从跟踪缓冲中取出最多count个最早的事件放到用户空间buf处，
+// 返回取出的事件数。若有事件已被覆盖，则先返回一个SE_LOST事件。
+int sys_schedtrace(struct sched_event * buf, int count)
+{
+	struct sched_event e;
+	unsigned long flags;
+	int n;
+
+	if (count <= 0)
+		return -EINVAL;
+	if (count > NR_SCHED_EVENTS + 1)
+		count = NR_SCHED_EVENTS + 1;
+	verify_area(buf, count * sizeof(struct sched_event));
+	for (n = 0 ; n < count ; n++) {
+		save_flags(flags);
+		cli();
+		if (se_head == se_tail) {
+			restore_flags(flags);
+			break;
+		}
+		e = sched_events[se_tail & (NR_SCHED_EVENTS-1)];
+		if (se_lost) {
+			e.se_type = SE_LOST;
+			e.se_state = 0;
+			e.se_pid = e.se_other = -1;
+			e.se_where = se_lost;
+			se_lost = 0;
+		} else
+			se_tail++;
+		restore_flags(flags);
+		memcpy_tofs(buf + n, &e, sizeof(struct sched_event));
+	}
+	return n;
+}
+#else
+int sys_schedtrace(struct sched_event * buf, int count)
+{
+	return -ENOSYS;
+}
+#endif
+
+/*
+ * A nanosleep() in progress. It lives on the sleeper's kernel stack.
+ * The wheel timer goes off at the start of the tick the sleep ends in,
+ * and then the sleep waits on 'split_list' for the interrupt 'off'
+ * clocks into that tick.
+ */
+struct hr_sleep {
+	struct timer_list timer;
+	unsigned long off;
+	struct task_struct * task;
+	struct hr_sleep * next;
+	int done;
+};
+
+static struct hr_sleep * split_list = NULL;
+
+static void hr_wake(struct hr_sleep * s)
+{
+	s->done = 1;
+	wake_up_process(s->task);
+}
+
+// 已到滴答内'pos'处：唤醒所有到期的睡眠者，返回剩下的睡眠者中最早的位置，
+// 没有的话返回LATCH。调用时必须已关中断。
+static unsigned long split_wake(unsigned long pos)
+{
+	struct hr_sleep ** pp, * s;
+	unsigned long next = LATCH;
+
+	for (pp = &split_list ; (s = *pp) ; )
+		if (s->off <= pos) {
+			*pp = s->next;
+			hr_wake(s);
+		} else {
+			if (s->off < next)
+				next = s->off;
+			pp = &s->next;
+		}
+	return next;
+}
+
+// 从'pos'开始一段到'next'为止的计数周期。每一段以及剩到滴答结束的部分都不能
+// 短于SPLIT_MIN，不够的就推迟或者直接延到滴答结束。
+static void split_program(unsigned long pos, unsigned long next)
+{
+	if (next < pos + SPLIT_MIN)
+		next = pos + SPLIT_MIN;
+	if (next + SPLIT_MIN > LATCH)
+		next = LATCH;
+	pit_program(pos, next - pos);
+}
+
+// 睡眠结束所在的滴答已开始(或本来就在当前滴答内)：把睡眠者挂入split_list，
+// 若它比当前计数周期结束得早，则把计数周期截到它那里。
+static void hr_arm(unsigned long data)
+{
+	struct hr_sleep * s = (struct hr_sleep *) data;
+	unsigned long now = pit_elapsed();
+
+	if (s->off <= now) {
+		hr_wake(s);
+		return;
+	}
+	s->next = split_list;
+	split_list = s;
+	if (s->off < pit_base + pit_reload && now + 2*SPLIT_MIN <= LATCH)
+		split_program(now, s->off);
+}
+
+//// 系统调用nanosleep：睡眠req指定的时间，精度为8253的时钟(约0.84微秒)而不是滴答。
+// 被信号中断时返回-EINTR，若rem不为空则在其中填入剩余的时间。
+int sys_nanosleep(struct timespec * req, struct timespec * rem)
+{
+	struct hr_sleep s;
+	unsigned long sec, nsec, counts, ticks, now, flags;
+
+	sec = get_fs_long((unsigned long *) &req->tv_sec);
+	nsec = get_fs_long((unsigned long *) &req->tv_nsec);
+	if ((long) sec < 0 || nsec >= 1000000000)
+		return -EINVAL;
+    // 把微秒换算成8253的时钟数(1193.18个/毫秒)，加上当前滴答已过去的时钟数，得出
+    // 睡眠结束于第几个滴答(ticks)以及该滴答内的位置(off)。离滴答结束太近的就延到
+    // 下一个滴答开始，免得计数周期太短。
+	counts = (nsec / 1000) * 1193 / 1000;
+	save_flags(flags);
+	cli();
+	now = pit_elapsed();
+	counts += now;
+	ticks = sec * HZ + counts / LATCH;
+	s.off = counts % LATCH;
+	if (s.off > LATCH - SPLIT_MIN) {
+		ticks++;
+		s.off = 0;
+	}
+	s.task = current;
+	s.next = NULL;
+	s.done = 0;
+	init_timer(&s.timer);
+	s.timer.expires = jiffies + ticks;
+	s.timer.data = (unsigned long) &s;
+	s.timer.function = hr_arm;
+	if (ticks)
+		start_timer(&s.timer);
+	else
+		hr_arm((unsigned long) &s);
+	while (!s.done && !(current->signal & ~current->blocked)) {
+		current->state = TASK_INTERRUPTIBLE;
+		schedule();
+	}
+	if (s.done) {
+		restore_flags(flags);
+		return 0;
+	}
+    // 被信号中断：取消定时器或者从split_list中取下，并计算剩余时间。
+	if (del_timer(&s.timer))
+		ticks = s.timer.expires - jiffies;
 	else {
-        // 否则从定时器数组中，找一个空闲项。
-		for (p = timer_list ; p < timer_list + TIME_REQUESTS ; p++)
-			if (!p->fn)
+		struct hr_sleep ** pp;
+
+		for (pp = &split_list ; *pp ; pp = &(*pp)->next)
+			if (*pp == &s) {
+				*pp = s.next;
 				break;
-        // 如果已经用完了定时器数组，则系统崩溃;-).否则向定时器数据结构填入相应信息，
-        // 并链入链表头。
-		if (p >= timer_list + TIME_REQUESTS)
-			panic("No more time requests free");
-		p->fn = fn;
-		p->jiffies = jiffies;
-		p->next = next_timer;
-		next_timer = p;
-        // 链表项按定时值从小到大排序。在排序时减去排在前面需要的滴答数，这样在
-        // 处理定时器时只要查看链表头的第一项的定时是否到期即可。[[ 这段程序没有
-        // 考虑周全。如果新插入的定时器值小于原来头一个定时器值时根本不会进入循环中，
-        // 但此时还是应该将紧随其后面的一个定时器值减去新的第一个定时值。即如果
-        // 第1个定时值<=第2个，则第2个定时值扣除第1个的值即可，否则进入下面循环中进行处理]]
-		while (p->next && p->next->jiffies < p->jiffies) {
-			p->jiffies -= p->next->jiffies;
-			fn = p->fn;
-			p->fn = p->next->fn;
-			p->next->fn = fn;
-			jiffies = p->jiffies;
-			p->jiffies = p->next->jiffies;
-			p->next->jiffies = jiffies;
-			p = p->next;
+			}
+		ticks = 0;
+	}
+	now = pit_elapsed();
+	restore_flags(flags);
+	if (rem) {
+		long left = (ticks % HZ) * (1000000000/HZ) +
+			((long) s.off - (long) now) * 838;
+
+		sec = ticks / HZ;
+		if (left < 0) {
+			if (sec) {
+				sec--;
+				left += 1000000000;
+			} else
+				left = 0;
 		}
+		nsec = left;
+		verify_area(rem, sizeof(struct timespec));
+		put_fs_long(sec, (unsigned long *) &rem->tv_sec);
+		put_fs_long(nsec, (unsigned long *) &rem->tv_nsec);
+	}
+	return -EINTR;
+}
+
+// 返回还有多少个滴答(最多max个)就会有定时器到期。时间轮转过一圈的滴答也算，
+// 因为那时可能有定时器从上一级降下来。
+static unsigned long next_timer_ticks(unsigned long max)
+{
+	unsigned long n, t;
+
+	for (n = 1 ; n < max ; n++) {
+		t = timer_jiffies + n - 1;
+		if (!(t & TVR_MASK) || tv1[t & TVR_MASK])
+			break;
+	}
+	return n;
+}
+
+/*
+ * cpu_idle() is called by task 0 when there is nothing else to run. It
+ * first clears free pages for get_free_page() (see zero_idle_page() in
+ * mm/memory.c) as long as nothing becomes runnable, then halts until the
+ * next interrupt. If nothing needs the regular tick (no timer due in the
+ * next few ticks, no floppy motor or beep counting down, no nanosleep in
+ * the middle of a tick), the 8253 is first set to fire only at the next
+ * timer, so that an idle machine isn't woken up a hundred times a
+ * second. If some other interrupt comes first, the ticks that have gone
+ * by are added to jiffies here; the timers catch up on the next tick.
+ */
+static void cpu_idle(void)
+{
+	extern int beepcount;
+	unsigned long n, now;
+
+	while (zero_idle_page())
+		if (active->bitmap || expired->bitmap)
+			return;
+	cli();
+	if (active->bitmap || expired->bitmap) {
+		sti();
+		return;
+	}
+	if (!split_list && !beepcount && !(current_DOR & 0xf0) &&
+	    !pit_base && pit_reload == LATCH &&
+	    (n = next_timer_ticks(MAX_IDLE_TICKS)) > 1) {
+		now = pit_elapsed();
+		pit_program(now, n*LATCH - now);
+	}
+	__asm__("sti ; hlt");
+	cli();
+	if (pit_base + pit_reload > LATCH) {
+		now = pit_elapsed();
+		jiffies += now / LATCH;
+		now %= LATCH;
+		pit_program(now, LATCH - now);
 	}
 	sti();
 }
 
+//// 定期唤醒写回进程的定时器。
+static struct timer_list bdflush_timer;
+
+static void bdflush_timeout(unsigned long data)
+{
+	wakeup_bdflush();
+	bdflush_timer.expires += BDFLUSH_INTERVAL;
+	start_timer(&bdflush_timer);
+}
+
 /// 时钟中断C函数处理程序，在system_call.s中timer_interrupt被调用。
 // 参数cpl是当前特权级0或3，是时钟中断发生时正在被执行的代码选择符中的特权级。
 // cpl=0时表示中断发生时正在执行内核代码；cpl=3表示中断发生时正在执行用户代码。
@@ -444,6 +1065,24 @@ void do_timer(long cpl)
 {
 	extern int beepcount;               // 扬声器发声滴答数
 	extern void sysbeepstop(void);      // 关闭扬声器。
+	unsigned long end = pit_base + pit_reload;
+
+    // 先看这是哪种中断。计数周期在滴答中间结束的是nanosleep的分段中断，它不算
+    // 一个滴答：撤销timer_interrupt中对jiffies的递增，唤醒到期的睡眠者并设置下一段。
+    // 否则若计数周期不是普通的一个滴答(空闲时跳过了几个滴答，或分段后的最后一段)，
+    // 则补上跳过的滴答并恢复每滴答一次的计数。滴答结束时还在等的睡眠者都已到期。
+	if (end < LATCH) {
+		jiffies--;
+		pit_base = end;                 // 让pit_elapsed()在唤醒时读出正确的时间
+		split_program(end, split_wake(end));
+		return;
+	}
+	if (pit_base || end != LATCH) {
+		jiffies += end / LATCH - 1;
+		pit_program(0, LATCH);
+	}
+	if (split_list)
+		split_wake(LATCH);
 
     // 如果发声计数次数到，则关闭发声。(向0x61口发送命令，复位位0和1，位0
     // 控制8253计数器2的工作，位1控制扬声器)
@@ -457,20 +1096,8 @@ void do_timer(long cpl)
 	else
 		current->stime++;
 
-    // 如果有定时器存在，则将链表第1个定时器的值减1.如果已等于0，则调用相应的
-    // 处理程序，并将该处理程序指针置空。然后去掉该项定时器。next_timer是定时器
-    // 链表的头指针。
-	if (next_timer) {
-		next_timer->jiffies--;
-		while (next_timer && next_timer->jiffies <= 0) {
-			void (*fn)(void);       // 这里插入了一个函数指针定义!!!! o(︶︿︶)o 
-			
-			fn = next_timer->fn;
-			next_timer->fn = NULL;
-			next_timer = next_timer->next;
-			(fn)();                 // 调用处理函数
-		}
-	}
+    // 处理时间轮中到期的定时器(软驱马达定时、任务的alarm等)。
+	run_timers();
     // 如果当前软盘控制器FDC的数字输出寄存器中马达启动位有置位的，则执行软盘定时程序
 	if (current_DOR & 0xf0)
 		do_floppy_timer();
@@ -494,7 +1121,7 @@ int sys_alarm(long seconds)
 
 	if (old)
 		old = (old - jiffies) / HZ;
-	current->alarm = (seconds>0)?(jiffies+HZ*seconds):0;
+	set_alarm((seconds>0)?(jiffies+HZ*seconds):0);
 	return (old);
 }
 
@@ -577,12 +1204,17 @@ void sched_init(void)
 	__asm__("pushfl ; andl $0xffffbfff,(%esp) ; popfl");        // 复位NT标志
 	ltr(0);
 	lldt(0);
-    // 下面代码用于初始化8253定时器。通道0，选择工作方式3，二进制计数方式。通道0的
+    // 下面代码用于初始化8253定时器。通道0，选择工作方式2，二进制计数方式。通道0的
     // 输出引脚接在中断控制主芯片的IRQ0上，它每10毫秒发出一个IRQ0请求。LATCH是初始
-    // 定时计数值。
-	outb_p(0x36,0x43);		/* binary, mode 3, LSB/MSB, ch 0 */
+    // 定时计数值。用方式2(速率发生器)而不是方式3，是为了能读出当前计数值，见pit_elapsed()。
+	outb_p(0x34,0x43);		/* binary, mode 2, LSB/MSB, ch 0 */
 	outb_p(LATCH & 0xff , 0x40);	/* LSB */
 	outb(LATCH >> 8 , 0x40);	/* MSB */
+    // 每隔BDFLUSH_INTERVAL个滴答唤醒一次写回进程，把已修改的空闲缓冲块写盘。
+	init_timer(&bdflush_timer);
+	bdflush_timer.expires = BDFLUSH_INTERVAL;
+	bdflush_timer.function = bdflush_timeout;
+	start_timer(&bdflush_timer);
     // 设置时钟中断处理程序句柄(设置时钟中断门)。修改中断控制器屏蔽码，允许时钟中断。
     // 然后设置系统调用中断门。这两个设置中断描述符表IDT中描述符在宏定义在文件
     // include/asm/system.h中。
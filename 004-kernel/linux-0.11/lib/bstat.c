@@ -0,0 +1,9 @@
+/*
+ *  linux/lib/bstat.c
+ */
+
+#define __LIBRARY__
+#include <unistd.h>
+#include <sys/bstat.h>
+
+_syscall2(int,bstat,int,index,struct bstat *,buf)
@@ -0,0 +1,8 @@
+/*
+ *  linux/lib/fallocate.c
+ */
+
+#define __LIBRARY__
+#include <unistd.h>
+
+_syscall3(int,fallocate,int,fildes,off_t,offset,off_t,len)
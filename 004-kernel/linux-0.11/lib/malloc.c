@@ -7,7 +7,8 @@
  * can be called from the interrupt level.
  *
  * Limitations: maximum size of memory we can allocate using this routine
- *	is 4k, the size of a page in Linux.
+ *	is 128k, the largest block of pages get_free_pages() hands out.
+ *	Anything bigger than a page gets a block of pages of its own.
  *
  * The general game plan is that each page (called a bucket) will only hold
  * objects of a given size.  When all of the object on a page are released,
@@ -91,6 +92,13 @@ struct _bucket_dir bucket_dir[] = {
  */
 struct bucket_desc *free_bucket_desc = (struct bucket_desc *) 0;
 
+/*
+ * Objects bigger than a page are kept on this chain, one bucket
+ * descriptor for each block of pages, with the order of the block in
+ * bucket_size.
+ */
+struct bucket_desc *big_chain = (struct bucket_desc *) 0;
+
 /*
  * This routine initializes a bucket description page.
  */
@@ -114,6 +122,56 @@ static inline void init_bucket_desc()
 	free_bucket_desc = first;
 }
 
+static void *malloc_big(unsigned int len)
+{
+	struct bucket_desc	*bdesc;
+	int			order = 0;
+
+	while ((PAGE_SIZE << order) < len)
+		order++;
+	if (order >= NR_MEM_LISTS) {
+		printk("malloc called with impossibly large argument (%d)\n",
+			len);
+		panic("malloc: bad arg");
+	}
+	cli();	/* Avoid race conditions */
+	if (!free_bucket_desc)
+		init_bucket_desc();
+	bdesc = free_bucket_desc;
+	free_bucket_desc = bdesc->next;
+	bdesc->page = (void *) get_free_pages(order);
+	if (!bdesc->page)
+		panic("Out of memory in kernel malloc()");
+	bdesc->freeptr = 0;
+	bdesc->refcnt = 1;
+	bdesc->bucket_size = order;
+	bdesc->next = big_chain;
+	big_chain = bdesc;
+	sti();
+	return(bdesc->page);
+}
+
+/*
+ * Frees an object malloc_big() handed out.  Returns 0 if obj isn't one.
+ */
+static int free_big(void *obj)
+{
+	struct bucket_desc	*bdesc, **p;
+
+	cli();
+	for (p = &big_chain; (bdesc = *p); p = &bdesc->next)
+		if (bdesc->page == obj) {
+			*p = bdesc->next;
+			free_pages((unsigned long) obj, bdesc->bucket_size);
+			bdesc->next = free_bucket_desc;
+			free_bucket_desc = bdesc;
+			sti();
+			return 1;
+		}
+	sti();
+	return 0;
+}
+
 void *malloc(unsigned int len)
 {
 	struct _bucket_dir	*bdir;
@@ -127,11 +185,8 @@ void *malloc(unsigned int len)
 	for (bdir = bucket_dir; bdir->size; bdir++)
 		if (bdir->size >= len)
 			break;
-	if (!bdir->size) {
-		printk("malloc called with impossibly large argument (%d)\n",
-			len);
-		panic("malloc: bad arg");
-	}
+	if (!bdir->size)
+		return malloc_big(len);
 	/*
 	 * Now we search for a bucket descriptor which has free space
 	 */
@@ -185,6 +240,10 @@ void free_s(void *obj, int size)
 	struct _bucket_dir	*bdir;
 	struct bucket_desc	*bdesc, *prev;
 	bdesc = prev = 0;
+	/* Blocks of pages are page aligned */
+	if ((!size || size > PAGE_SIZE) && !((unsigned long) obj & 0xfff) &&
+	    free_big(obj))
+		return;
 	/* Calculate what page this object lives in */
 	page = (void *)  ((unsigned long) obj & 0xfffff000);
 	/* Now search the buckets looking for that page */
@@ -0,0 +1,9 @@
+/*
+ *  linux/lib/schedtrace.c
+ */
+
+#define __LIBRARY__
+#include <unistd.h>
+#include <sys/schedtrace.h>
+
+_syscall2(int,schedtrace,struct sched_event *,buf,int,count)
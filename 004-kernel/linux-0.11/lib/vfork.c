@@ -0,0 +1,28 @@
+/*
+ *  linux/lib/vfork.c
+ */
+
+#define __LIBRARY__
+#include <unistd.h>
+
+#define __str(x) #x
+#define str(x) __str(x)
+
+/*
+ * This can't be a _syscall0: the child runs on our stack until it
+ * execs or exits, and overwrites the return address the parent would
+ * use. So it's taken off the stack before the system call, and both
+ * return through %ecx instead, which the system call preserves.
+ */
+__asm__(".text\n\t.align 4\n"
+	".globl vfork\n"
+	"vfork:\n\t"
+	"popl %ecx\n\t"
+	"movl $" str(__NR_vfork) ",%eax\n\t"
+	"int $0x80\n\t"
+	"testl %eax,%eax\n\t"
+	"jns 1f\n\t"
+	"negl %eax\n\t"
+	"movl %eax,errno\n\t"
+	"movl $-1,%eax\n"
+	"1:\tjmp *%ecx");
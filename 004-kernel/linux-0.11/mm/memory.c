@@ -49,13 +49,12 @@ static inline volatile void oom(void)
 __asm__("movl %%eax,%%cr3"::"a" (0))
 
 /* these are not to be changed without changing head.s etc */
-// linux0.11内核默认支持的最大内存容量是16MB，可以修改这些定义适合更多的内存。
 // 内存低端(1MB)
 #define LOW_MEM 0x100000
-// 分页内存15 MB，主内存区最多15M.
-#define PAGING_MEMORY (15*1024*1024)
-// 分页后的物理内存页面数（3840）
-#define PAGING_PAGES (PAGING_MEMORY>>12)
+// head.s中的页表对等映射的物理内存(16MB)。更多的内存由mem_init()映射。
+#define HEAD_MEMORY (16*1024*1024)
+// 分页后的物理内存页面数，由mem_init()根据实际内存大小设置。
+#define PAGING_PAGES paging_pages
 // 指定地址映射为页号
 #define MAP_NR(addr) (((addr)-LOW_MEM)>>12)
 // 页面被占用标志.
@@ -68,61 +67,223 @@ __asm__("movl %%eax,%%cr3"::"a" (0))
 current->start_code + current->end_code)
 
 static long HIGH_MEMORY = 0;            // 全局变量，存放实际物理内存最高端地址
+static unsigned long paging_pages = 0;  // 1MB以上的物理内存页面数
 
 // 从from处复制1页内存到to处(4K字节)。
 #define copy_page(from,to) \
 __asm__("cld ; rep ; movsl"::"S" (from),"D" (to),"c" (1024))
 
+// 把page处的1页内存清零。
+#define clear_page(page) \
+__asm__("cld ; rep ; stosl"::"a" (0),"D" (page),"c" (1024))
+
 // 物理内存映射字节图（1字节代表1页内存）。每个页面对应的字节用于标志页面当前引
-// 用（占用）次数。它最大可以映射15MB的内存空间。在初始化函数mem_init()中，对于
-// 不能用做主内存页面的位置均都预先被设置成USED（100）.
-static unsigned char mem_map [ PAGING_PAGES ] = {0,};
+// 用（占用）次数。它由mem_init()按实际内存大小在主内存区的开始处分配。在mem_init()
+// 中，对于不能用做主内存页面的位置均都预先被设置成USED（100）.
+static unsigned char * mem_map = NULL;
+
+/*
+ * Free memory is kept by a buddy allocator: free_area[order] lists the
+ * free blocks of 2^order pages, each aligned to its own size (counted
+ * from LOW_MEM). The list links live in the first page of each free
+ * block. When a block is freed and its buddy is free too, they are
+ * merged into a block of the next order.
+ */
+struct free_block {
+	struct free_block * next;
+	struct free_block * prev;
+};
+
+static struct free_block * free_area[NR_MEM_LISTS] = {NULL, };
+
+// 空闲块首页面的阶加1。不是空闲块首页面的为0。用来判断伙伴块是否空闲。它和mem_map[]
+// 一起分配。
+static unsigned char * free_order = NULL;
+
+static unsigned long nr_free_pages = 0;     // 伙伴系统中的空闲页面数
 
 /*
- * Get physical address of first (actually last :-) free page, and mark it
- * used. If no free pages left, return 0.
+ * The zero page is mapped read-only wherever a task reads anonymous
+ * memory (bss, heap, stack) it has never written; the first write gets
+ * it a page of its own through do_wp_page(). It lives below LOW_MEM, so
+ * it is never counted in mem_map[] nor freed.
  */
-//// 在主内存区中取空闲屋里页面。如果已经没有可用物理内存页面，则返回0.
-// 输入：%1(ax=0) - 0; %2(LOW_MEM)内存字节位图管理的其实位置；%3(cx=PAGING_PAGES);
-// %4(edi=mem_map+PAGING_PAGES-1).
-// 输出：返回%0(ax=物理内存页面起始地址)。
-// 上面%4寄存器实际指向mem_map[]内存字节位图的最后一个字节。本函数从位图末端开
-// 始向前扫描所有页面标志（页面总数PAGING_PAGE），若有页面空闲（内存位图字节为
-// 0）则返回页面地址。注意！本函数只是指出在主内存区的一页空闲物理内存页面，但
-// 并没有映射到某个进程的地址空间中去。后面的put_page()函数即用于把指定页面映射
-// 到某个进程地址空间中。当然对于内核使用本函数并不需要再使用put_page()进行映射，
-// 因为内核代码和数据空间（16MB）已经对等地映射到物理地址空间。
+static unsigned long empty_zero_page[1024] __attribute__ ((aligned (4096)));
+#define ZERO_PAGE ((unsigned long) empty_zero_page)
+
+/*
+ * Pages cleared ahead of time by the idle task, see zero_idle_page().
+ * get_free_page() takes these first. They are only made while there is
+ * plenty of memory free, and given back when get_free_pages() runs out.
+ */
+#define NR_ZEROED 32
+#define ZERO_MIN_FREE 128
+
+static unsigned long zeroed_pages[NR_ZEROED];
+static int nr_zeroed = 0;
+
+static int shrink_page_cache(void);
+
+// 把页面号为nr、阶为order的块挂入空闲链表。调用时必须已关中断。
+static inline void add_block(unsigned long nr, int order)
+{
+	struct free_block * b = (struct free_block *) (LOW_MEM + (nr << 12));
+
+	b->prev = NULL;
+	if ((b->next = free_area[order]))
+		b->next->prev = b;
+	free_area[order] = b;
+	free_order[nr] = order + 1;
+	nr_free_pages += 1 << order;
+}
+
+// 把空闲块从阶为order的空闲链表中取下。调用时必须已关中断。
+static inline void remove_block(unsigned long nr, int order)
+{
+	struct free_block * b = (struct free_block *) (LOW_MEM + (nr << 12));
+
+	if (b->next)
+		b->next->prev = b->prev;
+	if (b->prev)
+		b->prev->next = b->next;
+	else
+		free_area[order] = b->next;
+	free_order[nr] = 0;
+	nr_free_pages -= 1 << order;
+}
+
+// 释放页面号为nr、阶为order的块(其中页面的引用计数都已为0)，并尽可能与伙伴块合并。
+// 调用时必须已关中断。
+static void release_block(unsigned long nr, int order)
+{
+	unsigned long buddy;
+
+	while (order < NR_MEM_LISTS-1) {
+		buddy = nr ^ (1 << order);
+		if (buddy >= PAGING_PAGES || free_order[buddy] != order + 1)
+			break;
+		remove_block(buddy, order);
+		nr &= ~(1 << order);
+		order++;
+	}
+	add_block(nr, order);
+}
+
+/*
+ * Get 2^order contiguous pages, aligned to their size, and mark them
+ * used. The memory is not cleared. If there is no block big enough
+ * left, return 0.
+ */
+//// 取2^order个连续的物理页面。先在阶为order的空闲链表中找，没有的话就从更大的块中
+// 拆分出来，拆下的另一半挂入低一阶的空闲链表。返回块的物理起始地址，失败返回0。
+unsigned long get_free_pages(int order)
+{
+	unsigned long flags, nr;
+	int i;
+
+	if (order < 0 || order >= NR_MEM_LISTS)
+		return 0;
+	save_flags(flags);
+	cli();
+repeat:
+	for (i = order ; i < NR_MEM_LISTS ; i++)
+		if (free_area[i])
+			break;
+	if (i == NR_MEM_LISTS) {
+    // 没有足够大的空闲块了。如果还有预先清零的页面，就把它们还给伙伴系统再试。
+		if (nr_zeroed) {
+			while (nr_zeroed) {
+				nr = MAP_NR(zeroed_pages[--nr_zeroed]);
+				mem_map[nr] = 0;
+				release_block(nr, 0);
+			}
+			goto repeat;
+		}
+    // 再试试释放页面缓存中没有任务在用的页面。
+		if (shrink_page_cache())
+			goto repeat;
+		restore_flags(flags);
+		return 0;
+	}
+	nr = MAP_NR((unsigned long) free_area[i]);
+	remove_block(nr, i);
+	while (i > order) {
+		i--;
+		add_block(nr + (1 << i), i);
+	}
+	for (i = 0 ; i < (1 << order) ; i++)
+		mem_map[nr + i] = 1;
+	restore_flags(flags);
+	return LOW_MEM + (nr << 12);
+}
+
+/*
+ * Get physical address of a free page, cleared, and mark it used. If no
+ * free pages left, return 0.
+ */
+//// 在主内存区中取一页空闲物理页面并清零。如果已经没有可用物理内存页面，则返回0.
+// 注意！本函数只是取得主内存区的一页空闲物理内存页面，但并没有映射到某个进程的地址
+// 空间中去。后面的put_page()函数即用于把指定页面映射到某个进程地址空间中。当然对于
+// 内核使用本函数并不需要再使用put_page()进行映射，因为内核代码和数据空间已经把全部物理内存
+// 对等地映射到了线性地址空间(见mem_init())。
 unsigned long get_free_page(void)
 {
-register unsigned long __res asm("ax");
-
-__asm__("std ; repne ; scasb\n\t"   // 置方向位，al(0)与对应每个页面的(di)内容比较
-	"jne 1f\n\t"                    // 如果没有等于0的字节，则跳转结束(返回0).
-	"movb $1,1(%%edi)\n\t"          // 1 => [1+edi],将对应页面内存映像bit位置1.
-	"sall $12,%%ecx\n\t"            // 页面数*4k = 相对页面其实地址
-	"addl %2,%%ecx\n\t"             // 再加上低端内存地址，得页面实际物理起始地址
-	"movl %%ecx,%%edx\n\t"          // 将页面实际其实地址->edx寄存器。
-	"movl $1024,%%ecx\n\t"          // 寄存器ecx置计数值1024
-	"leal 4092(%%edx),%%edi\n\t"    // 将4092+edx的位置->dei（该页面的末端地址）
-	"rep ; stosl\n\t"               // 将edi所指内存清零(反方向，即将该页面清零)
-	"movl %%edx,%%eax\n"            // 将页面起始地址->eax（返回值）
-	"1:"
-	:"=a" (__res)
-	:"0" (0),"i" (LOW_MEM),"c" (PAGING_PAGES),
-	"D" (mem_map+PAGING_PAGES-1)
-	);
-return __res;           // 返回空闲物理页面地址(若无空闲页面则返回0).
+	unsigned long flags, page;
+
+    // 优先使用空闲任务预先清零的页面，省得在这里清零。
+	save_flags(flags);
+	cli();
+	if (nr_zeroed) {
+		page = zeroed_pages[--nr_zeroed];
+		restore_flags(flags);
+		return page;
+	}
+	restore_flags(flags);
+	if ((page = get_free_pages(0)))
+		clear_page(page);
+	return page;            // 返回空闲物理页面地址(若无空闲页面则返回0).
+}
+
+/*
+ * zero_idle_page() is called by the idle task. It clears one free page
+ * for the pool get_free_page() takes from, with interrupts enabled, and
+ * returns 1. If the pool is full, or memory is getting short, it does
+ * nothing and returns 0.
+ */
+//// 空闲时清零一个页面，放入预先清零页面池。
+int zero_idle_page(void)
+{
+	unsigned long flags, page;
+
+	if (nr_zeroed >= NR_ZEROED || nr_free_pages < ZERO_MIN_FREE)
+		return 0;
+	if (!(page = get_free_pages(0)))
+		return 0;
+	clear_page(page);
+	save_flags(flags);
+	cli();
+	if (nr_zeroed < NR_ZEROED) {
+		zeroed_pages[nr_zeroed++] = page;
+		page = 0;
+	}
+	restore_flags(flags);
+	if (page)               // 清零时池已被别人填满(中断中不会发生，只是以防万一)
+		free_page(page);
+	return 1;
 }
 
 /*
- * Free a page of memory at physical address 'addr'. Used by
- * 'free_page_tables()'
+ * Free 2^order pages at physical address 'addr', as got from
+ * get_free_pages(). Used by 'free_page_tables()' through free_page().
  */
-//// 释放物理地址addr开始的1页面内存。
+//// 释放物理地址addr开始的2^order个页面。
 // 物理地址1MB以下的内容空间用于内核程序和缓冲，不作为分配页面的内存空间。因此
 // 参数addr需要大于1MB.
-void free_page(unsigned long addr)
+void free_pages(unsigned long addr, int order)
 {
+	unsigned long flags, nr;
+	int i, free;
+
     // 首先判断参数给定的物理地址addr的合理性。如果物理地址addr小于内存低端(1MB)
     // 则表示在内核程序或高速缓冲中，对此不予处理。如果物理地址addr>=系统所含物
     // 理内存最高端，则显示出错信息并且内核停止工作。
@@ -130,15 +291,35 @@ void free_page(unsigned long addr)
 	if (addr >= HIGH_MEMORY)
 		panic("trying to free nonexistent page");
     // 如果对参数addr验证通过，那么就根据这个物理地址换算出从内存低端开始记起的
-    // 内存页面号。页面号 ＝ (addr - LOW_MEM)/4096.可见页面号从0号开始记起。此时
-    // addr中存放着页面号。如果该页面号对应的页面映射字节不等于0，则减1返回。此
-    // 时该映射字节值应该为0，表示页面已释放。如果对应页面字节原本就是0，表示该
-    // 物理页面本来就是空闲的，说明内核代码出问题。于是显示出错信息并停机。
-	addr -= LOW_MEM;
-	addr >>= 12;
-	if (mem_map[addr]--) return;
-	mem_map[addr]=0;
-	panic("trying to free free page");
+    // 内存页面号。页面号 ＝ (addr - LOW_MEM)/4096.可见页面号从0号开始记起。把块中
+    // 各页面的引用计数减1，若原本就是0，表示该物理页面本来就是空闲的，说明内核代码
+    // 出问题，于是停机。只有块中所有页面的引用计数都减到了0，才把整个块放回空闲链表；
+    // 若只有一部分页面减到了0，则块中还有页面在被使用，把块放回去就会出错，也停机。
+	nr = MAP_NR(addr);
+	save_flags(flags);
+	cli();
+	for (i = 0, free = 0 ; i < (1 << order) ; i++) {
+		if (!mem_map[nr + i]--) {
+			mem_map[nr + i] = 0;
+			panic("trying to free free page");
+		}
+		if (!mem_map[nr + i])
+			free++;
+	}
+	if (free == (1 << order))
+		release_block(nr, order);
+	else if (free)
+		panic("free_pages: pages of a block freed separately");
+	restore_flags(flags);
+}
+
+/*
+ * Free a page of memory at physical address 'addr'.
+ */
+//// 释放物理地址addr开始的1页面内存。页面被共享时只是递减它的引用计数。
+void free_page(unsigned long addr)
+{
+	free_pages(addr, 0);
 }
 
 /*
@@ -184,6 +365,13 @@ int free_page_tables(unsigned long from,unsigned long size)
 		if (!(1 & *dir))
 			continue;
 		pg_table = (unsigned long *) (0xfffff000 & *dir);  // 取页表地址
+        // 若该页表还被别的任务共享(见share_page_tables())，则只递减页表的引用计数，
+        // 页表中的页面仍归别的任务使用。
+		if (mem_map[MAP_NR((unsigned long) pg_table)] > 1) {
+			free_page((unsigned long) pg_table);
+			*dir = 0;
+			continue;
+		}
 		for (nr=0 ; nr<1024 ; nr++) {
 			if (1 & *pg_table)                          // 若该项有效，则释放对应页。 
 				free_page(0xfffff000 & *pg_table);
@@ -299,6 +487,98 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 	return 0;
 }
 
+/*
+ * share_page_tables() is the lazy version of copy_page_tables(), used
+ * by fork(): the page tables themselves are shared, and the directory
+ * entries of both tasks made read-only. A task gets its own copy of a
+ * page table only when it writes to (or maps a new page into) the 4Mb
+ * the table covers, see unshare_page_table(). A child that soon calls
+ * execve() never copies anything. As with copy_page_tables(), 'from'
+ * must not be 0: kernel space is never shared like this.
+ */
+//// 共享页表
+// 让to处的页目录项与from处的页目录项指向同一个页表，并把两个目录项都设为只读。
+// 页表的引用计数(mem_map[])记录共享它的目录项个数。
+int share_page_tables(unsigned long from,unsigned long to,long size)
+{
+	unsigned long * from_dir, * to_dir;
+
+	if ((from&0x3fffff) || (to&0x3fffff))
+		panic("share_page_tables called with wrong alignment");
+	if (!from)
+		panic("Trying to share swapper memory space");
+	from_dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
+	to_dir = (unsigned long *) ((to>>20) & 0xffc);
+	size = ((unsigned) (size+0x3fffff)) >> 22;
+	for( ; size-->0 ; from_dir++,to_dir++) {
+		if (1 & *to_dir)
+			panic("share_page_tables: already exist");
+		if (!(1 & *from_dir))
+			continue;
+		*from_dir &= ~2;
+		*to_dir = *from_dir;
+		mem_map[MAP_NR(0xfffff000 & *from_dir)]++;
+	}
+	invalidate();
+	return 0;
+}
+
+//// 取消页表共享
+// 页目录项*dir是只读的，即它指向的页表可能被几个任务共享。若页表已没有别的任务共享，
+// 则恢复目录项的写权限即可。否则为当前任务复制一个页表：与copy_page_tables()一样，
+// 页表中的页面在两个页表中都设为只读，并递增它们的引用计数，以后由写时复制处理。
+static void unshare_page_table(unsigned long * dir)
+{
+	unsigned long * old_table, * new_table;
+	unsigned long this_page;
+	int nr;
+
+	old_table = (unsigned long *) (0xfffff000 & *dir);
+	if (mem_map[MAP_NR((unsigned long) old_table)] == 1) {
+		*dir |= 2;
+		invalidate();
+		return;
+	}
+	if (!(new_table = (unsigned long *) get_free_page()))
+		oom();
+	for (nr = 0 ; nr < 1024 ; nr++) {
+		this_page = old_table[nr];
+		if (!(1 & this_page))
+			continue;
+		this_page &= ~2;
+		old_table[nr] = this_page;
+		new_table[nr] = this_page;
+		if (this_page > LOW_MEM)
+			mem_map[MAP_NR(this_page & 0xfffff000)]++;
+	}
+	mem_map[MAP_NR((unsigned long) old_table)]--;
+	*dir = ((unsigned long) new_table) | 7;
+	invalidate();
+}
+
+//// 取线性地址address对应的页表项指针。
+// 根据address计算其在页目录表中对应的目录项指针，并从中取得二级页表地址。如果
+// 该目录项有效(P=1),即指定的页表在内存中，则从中取得指定页表地址。否则就申请一
+// 空闲页面给页表使用，并在对应目录项中置相应标志(7 - User、U/S、R/W)。页表项在
+// 页表中索引值等于线性地址位21 -- 位12组成的10bit的值。页表内存不够时返回NULL。
+static unsigned long * get_page_entry(unsigned long address)
+{
+	unsigned long tmp, *page_table;
+
+	page_table = (unsigned long *) ((address>>20) & 0xffc);
+	if ((*page_table)&1) {
+		if (!((*page_table)&2))             // 页表被共享，先复制一份
+			unshare_page_table(page_table);
+		page_table = (unsigned long *) (0xfffff000 & *page_table);
+	} else {
+		if (!(tmp=get_free_page()))
+			return NULL;
+		*page_table = tmp|7;
+		page_table = (unsigned long *) tmp;
+	}
+	return page_table + ((address>>12) & 0x3ff);
+}
+
 /*
  * This function puts a page in memory at the wanted address.
  * It returns the physical address of the page gotten, 0 if
@@ -315,7 +595,7 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 // 参数page是分配的主内存区中某一页面(页帧，页框)的指针;address是线性地址。
 unsigned long put_page(unsigned long page,unsigned long address)
 {
-	unsigned long tmp, *page_table;
+	unsigned long *page_table;
 
 /* NOTE !!! This uses the fact that _pg_dir=0 */
 
@@ -328,28 +608,26 @@ unsigned long put_page(unsigned long page,unsigned long address)
 		printk("Trying to put page %p at %p\n",page,address);
 	if (mem_map[(page-LOW_MEM)>>12] != 1)
 		printk("mem_map disagrees with %p at %p\n",page,address);
-    // 然后根据参数指定的线性地址address计算其在也目录表中对应的目录项指针，并
-    // 从中取得二级页表地址。如果该目录项有效(P=1),即指定的页表在内存中，则从中
-    // 取得指定页表地址放到page_table 变量中。否则就申请一空闲页面给页表使用，并
-    // 在对应目录项中置相应标志(7 - User、U/S、R/W).然后将该页表地址放到page_table
-    // 变量中。
-	page_table = (unsigned long *) ((address>>20) & 0xffc);
-	if ((*page_table)&1)
-		page_table = (unsigned long *) (0xfffff000 & *page_table);
-	else {
-		if (!(tmp=get_free_page()))
-			return 0;
-		*page_table = tmp|7;
-		page_table = (unsigned long *) tmp;
-	}
-    // 最后在找到的页表page_table中设置相关页表内容，即把物理页面page的地址填入
-    // 表项同时置位3个标志(U/S、W/R、P)。该页表项在页表中索引值等于线性地址位21
-    // -- 位12组成的10bit的值。每个页表共可有1024项(0 -- 0x3ff)。
-	page_table[(address>>12) & 0x3ff] = page | 7;
+	if (!(page_table = get_page_entry(address)))
+		return 0;
+    // 最后在找到的页表项中设置相关页表内容，即把物理页面page的地址填入
+    // 表项同时置位3个标志(U/S、W/R、P)。
+	*page_table = page | 7;
 /* no need for invalidate */
 	return page;
 }
 
+//// 把零页面只读地映射到线性地址address处。成功返回1，页表内存不够时返回0。
+static int put_zero_page(unsigned long address)
+{
+	unsigned long * page_table;
+
+	if (!(page_table = get_page_entry(address)))
+		return 0;
+	*page_table = ZERO_PAGE | 5;        // U/S、P，只读
+	return 1;
+}
+
 //// 取消写保护页面函数。用于页异常中断过程中写保护异常的处理(写时复制)。
 // 在内核创建进程时，新进程与父进程被设置成共享代码和数据内存页面，并且所有这些
 // 页面均被设置成只读页面。而当新进程或原进程需要向内存页面写数据时，CPU就会检测
@@ -378,14 +656,19 @@ void un_wp_page(unsigned long * table_entry)
     // 共享。如果原页面大于内存低端(则意味着mem_map[]>1,页面是共享的)，则将原页
     // 面的页面映射字节数组递减1。然后将指定页表项内容更新为新页面地址，并置可读
     // 写等标志（U/S、R/W、P）。在刷新页变换高速缓冲之后，最后将原页面内容复制
-    // 到新页面上。
-	if (!(new_page=get_free_page()))
+    // 到新页面上。零页面则不用复制，取一个清零的页面即可；要复制的页面就不必先清零。
+	if (old_page == ZERO_PAGE)
+		new_page = get_free_page();
+	else
+		new_page = get_free_pages(0);
+	if (!new_page)
 		oom();
 	if (old_page >= LOW_MEM)
 		mem_map[MAP_NR(old_page)]--;
 	*table_entry = new_page | 7;
 	invalidate();
-	copy_page(old_page,new_page);
+	if (old_page != ZERO_PAGE)
+		copy_page(old_page,new_page);
 }	
 
 /*
@@ -401,12 +684,19 @@ void un_wp_page(unsigned long * table_entry)
 // 写共享页面时，需复制页面（写时复制）.
 void do_wp_page(unsigned long error_code,unsigned long address)
 {
+	unsigned long * dir, * entry;
+
 #if 0
 /* we cannot do this yet: the estdio library writes to code space */
 /* stupid, stupid. I really want the libc.a from GNU */
 	if (CODE_SPACE(address))
 		do_exit(SIGSEGV);
 #endif
+    // 写保护异常也可能是因为页目录项只读，即页表被共享(见share_page_tables())。
+    // 这时先为当前任务复制页表。复制后若页面本身是可写的，就不用再做什么了。
+	dir = (unsigned long *) ((address>>20) & 0xffc);
+	if (!(2 & *dir))
+		unshare_page_table(dir);
     // 调用上面函数un_wp_page()来处理取消页面保护。但首先需要为其准备好参数。参
     // 数是线性地址address指定页面在页表中的页表项指针，其计算方法是：
     // 1.((address>>10) & 0xffc): 计算指定线性地址中页表项在页表中的偏移地址；因
@@ -425,10 +715,9 @@ void do_wp_page(unsigned long error_code,unsigned long address)
     // (0xfffff000 & *(unsigned log *) (((address>>22) & 0x3ff)<<2)).
     // 3.由1中页表项中偏移地址加上2中目录表项内容中对应页表的物理地址即可得到页
     // 表项的指针(物理地址)。这里对共享的页面进行复制。
-	un_wp_page((unsigned long *)
-		(((address>>10) & 0xffc) + (0xfffff000 &
-		*((unsigned long *) ((address>>20) &0xffc)))));
-
+	entry = (unsigned long *) (((address>>10) & 0xffc) + (0xfffff000 & *dir));
+	if (!(2 & *entry))
+		un_wp_page(entry);
 }
 
 //// 写页面验证
@@ -437,6 +726,7 @@ void do_wp_page(unsigned long error_code,unsigned long address)
 void write_verify(unsigned long address)
 {
 	unsigned long page;
+	unsigned long * dir = (unsigned long *) ((address>>20) & 0xffc);
 
     // 首先取指定线性地址对应的页目录项，根据目录项中的存在位P判断目录项对应的
     // 页表是否存在(存在位P=12),若不存在(P=0)则返回。这样处理是因为对于不存在的
@@ -445,8 +735,13 @@ void write_verify(unsigned long address)
     // 一个物理页面。
     // 接着程序从目录项中取页表地址，加上指定页面在页表中的页表项偏移值，得对应
     // 地址的页表项指针。在该表项中包含这给定线性地址对应的物理页面。
-	if (!( (page = *((unsigned long *) ((address>>20) & 0xffc)) )&1))
+	if (!( (page = *dir )&1))
 		return;
+    // 若页表被共享(目录项只读)，则先为当前任务复制页表，否则内核会写到别的任务的页面中。
+	if (!(page & 2)) {
+		unshare_page_table(dir);
+		page = *dir;
+	}
 	page &= 0xfffff000;
 	page += ((address>>10) & 0xffc);
     // 然后判断该页表项中的位1(R/W)、位0(P)标志。如果该页面不可写(R/W=0)且存在，
@@ -537,6 +832,9 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 			*(unsigned long *) to_page = to | 7;
 		else
 			oom();
+	} else if (!(to & 2)) {
+		unshare_page_table((unsigned long *) to_page);
+		to = *(unsigned long *) to_page;
 	}
     // 否则取目录项中的页表地址->to，加上页表项索引值<<2，即页表项在表中偏移地址，
     // 得到页表地址->to_page.针对页表项，如果我们此时我们检查出其对应的物理页面
@@ -616,6 +914,229 @@ static int share_page(unsigned long address)
 	return 0;
 }
 
+/*
+ * The page cache keeps pages of executables after they have been read
+ * in by do_no_page(), indexed by (device, inode number, offset), so that
+ * later faults on them - from any task, also after the one that read
+ * them has exited - map the page directly. A cached page has one
+ * mem_map[] reference for the cache; tasks map it read-only, so a task
+ * writing to it gets its own copy and the cached one stays clean.
+ *
+ * Entries are recycled least recently used first, but only if no task
+ * maps the page. When memory runs out, all pages no task maps are given
+ * back (shrink_page_cache()). Writing to or truncating a file throws its
+ * pages out, see invalidate_inode_pages(). An entry points to the in-core
+ * inode of its file, which counts its pages in i_cached_pages, so files
+ * without cached pages - nearly all of them - are not searched for any.
+ * When the inode is reused for another file, clear_inode() throws its
+ * pages out first.
+ */
+#define NR_PAGE_CACHE 256
+#define NR_PAGE_HASH 64
+
+struct cache_page {
+	unsigned short dev;
+	unsigned short ino;
+	unsigned long offset;
+	unsigned long page;                 /* 0 if the entry is unused */
+	struct m_inode * inode;             /* counts the page in i_cached_pages */
+	struct cache_page * next_hash;
+	struct cache_page * prev_lru;
+	struct cache_page * next_lru;
+};
+
+static struct cache_page page_cache[NR_PAGE_CACHE];
+static struct cache_page * page_hash[NR_PAGE_HASH];
+static struct cache_page * lru_head = NULL;     // 最近用过的在前，空闲项在最后
+static struct cache_page * lru_tail = NULL;
+
+#define _page_hashfn(dev,ino,offset) \
+	(((unsigned)((dev)^(ino)^((offset)>>12)))%NR_PAGE_HASH)
+#define page_hash_head(dev,ino,offset) page_hash[_page_hashfn(dev,ino,offset)]
+
+// 把缓存项从lru链表中取下。调用时必须已关中断，下同。
+static inline void lru_unlink(struct cache_page * cp)
+{
+	if (cp->prev_lru)
+		cp->prev_lru->next_lru = cp->next_lru;
+	else
+		lru_head = cp->next_lru;
+	if (cp->next_lru)
+		cp->next_lru->prev_lru = cp->prev_lru;
+	else
+		lru_tail = cp->prev_lru;
+}
+
+// 把缓存项放到lru链表头(最近用过)或尾(空闲项)。
+static inline void lru_insert(struct cache_page * cp, int tail)
+{
+	if (tail) {
+		cp->next_lru = NULL;
+		if ((cp->prev_lru = lru_tail))
+			lru_tail->next_lru = cp;
+		else
+			lru_head = cp;
+		lru_tail = cp;
+	} else {
+		cp->prev_lru = NULL;
+		if ((cp->next_lru = lru_head))
+			lru_head->prev_lru = cp;
+		else
+			lru_tail = cp;
+		lru_head = cp;
+	}
+}
+
+// 把缓存项从hash表中取下，释放缓存对页面的引用，并把缓存项放到lru链表尾。
+static void remove_cache_page(struct cache_page * cp)
+{
+	struct cache_page ** p = &page_hash_head(cp->dev,cp->ino,cp->offset);
+
+	for ( ; *p ; p = &(*p)->next_hash)
+		if (*p == cp) {
+			*p = cp->next_hash;
+			break;
+		}
+	cp->inode->i_cached_pages--;
+	free_page(cp->page);
+	cp->page = 0;
+	lru_unlink(cp);
+	lru_insert(cp,1);
+}
+
+// 查找缓存的页面，找到时把它移到lru链表头。
+static struct cache_page * find_cache_page(int dev, int ino, unsigned long offset)
+{
+	struct cache_page * cp;
+
+	for (cp = page_hash_head(dev,ino,offset) ; cp ; cp = cp->next_hash)
+		if (cp->dev == dev && cp->ino == ino && cp->offset == offset) {
+			lru_unlink(cp);
+			lru_insert(cp,0);
+			return cp;
+		}
+	return NULL;
+}
+
+// 把刚读入的页面放入缓存。从lru链表尾开始找一个空闲的、或者其页面已经没有任务
+// 在用的缓存项。都在用时不缓存，返回0。成功时页面的引用计数加1，返回1。
+static int add_cache_page(struct m_inode * inode, unsigned long offset,
+	unsigned long page)
+{
+	struct cache_page * cp;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (find_cache_page(inode->i_dev,inode->i_num,offset)) {
+		restore_flags(flags);
+		return 0;
+	}
+	for (cp = lru_tail ; cp ; cp = cp->prev_lru)
+		if (!cp->page || mem_map[MAP_NR(cp->page)] == 1)
+			break;
+	if (!cp) {
+		restore_flags(flags);
+		return 0;
+	}
+	if (cp->page)
+		remove_cache_page(cp);
+	cp->dev = inode->i_dev;
+	cp->ino = inode->i_num;
+	cp->offset = offset;
+	cp->page = page;
+	cp->inode = inode;
+	inode->i_cached_pages++;
+	mem_map[MAP_NR(page)]++;
+	cp->next_hash = page_hash_head(cp->dev,cp->ino,offset);
+	page_hash_head(cp->dev,cp->ino,offset) = cp;
+	lru_unlink(cp);
+	lru_insert(cp,0);
+	restore_flags(flags);
+	return 1;
+}
+
+// 释放所有没有任务在用的缓存页面，返回释放的页面数。由get_free_pages()在
+// 内存不够时调用(已关中断)。
+static int shrink_page_cache(void)
+{
+	int i, n = 0;
+
+	for (i = 0 ; i < NR_PAGE_CACHE ; i++)
+		if (page_cache[i].page && mem_map[MAP_NR(page_cache[i].page)] == 1) {
+			remove_cache_page(page_cache + i);
+			n++;
+		}
+	return n;
+}
+
+//// 使文件inode在页面缓存中的页面失效。在文件被写或截断、以及i节点被重用时调用。
+// 已映射这些页面的任务还继续使用它们。该文件没有缓存的页面时什么也不用做。
+void invalidate_inode_pages(struct m_inode * inode)
+{
+	unsigned long flags;
+	int i;
+
+	if (!inode->i_cached_pages)
+		return;
+	save_flags(flags);
+	cli();
+	for (i = 0 ; i < NR_PAGE_CACHE && inode->i_cached_pages ; i++)
+		if (page_cache[i].page && page_cache[i].inode == inode)
+			remove_cache_page(page_cache + i);
+	restore_flags(flags);
+}
+
+//// 使设备dev的所有缓存页面失效。在卸载文件系统或更换软盘时调用。
+void invalidate_dev_pages(int dev)
+{
+	unsigned long flags;
+	int i;
+
+	save_flags(flags);
+	cli();
+	for (i = 0 ; i < NR_PAGE_CACHE ; i++)
+		if (page_cache[i].page && page_cache[i].dev == dev)
+			remove_cache_page(page_cache + i);
+	restore_flags(flags);
+}
+
+//// 把缓存的页面page只读地映射到线性地址address处。调用者已为此递增了页面的
+// 引用计数。成功返回1，页表内存不够时返回0。
+static int put_cached_page(unsigned long page, unsigned long address)
+{
+	unsigned long * page_table;
+
+	if (!(page_table = get_page_entry(address)))
+		return 0;
+	*page_table = page | 5;             // U/S、P，只读
+	return 1;
+}
+
+//// 在页面缓存中查找执行文件inode中偏移offset处的页面，找到就映射到address处。
+// 返回1表示已映射。
+static int map_cache_page(struct m_inode * inode, unsigned long offset,
+	unsigned long address)
+{
+	struct cache_page * cp;
+	unsigned long flags, page = 0;
+
+	save_flags(flags);
+	cli();
+	if ((cp = find_cache_page(inode->i_dev,inode->i_num,offset))) {
+		page = cp->page;
+		mem_map[MAP_NR(page)]++;        // 在分配页表之前，以免页面被回收
+	}
+	restore_flags(flags);
+	if (!page)
+		return 0;
+	if (put_cached_page(page,address))
+		return 1;
+	free_page(page);
+	oom();
+	return 0;
+}
+
 //// 执行缺页处理
 // 是访问不存在页面处理函数。页异常中断处理过程中调用的函数。在page.s程序中被调
 // 用。函数参数error_code和address是进程在访问页面时由CPU因缺页产生异常而自动生
@@ -625,7 +1146,7 @@ static int share_page(unsigned long address)
 void do_no_page(unsigned long error_code,unsigned long address)
 {
 	int nr[4];
-	unsigned long tmp;
+	unsigned long tmp, off;
 	unsigned long page;
 	int block,i;
 
@@ -642,10 +1163,20 @@ void do_no_page(unsigned long error_code,unsigned long address)
     // 并映射到指定线性地址处。进程任务结构字段start_code是线性地址空间中进程代
     // 码段地址，字段end_data是代码加数据长度。对于Linux0.11内核，它的代码段和
     // 数据段其实基址相同。
+    // 读这样的页面时只映射零页面，等到写时再分配(见un_wp_page())。error_code的
+    // 位1(W/R)为0表示是读操作引起的缺页。
 	if (!current->executable || tmp >= current->end_data) {
+		if (!(error_code & 2)) {
+			if (!put_zero_page(address))
+				oom();
+			return;
+		}
 		get_empty_page(address);
 		return;
 	}
+    // 先在页面缓存中找，再看能否与运行同一执行文件的任务共享。
+	if (map_cache_page(current->executable,tmp,address))
+		return;
 	if (share_page(tmp))
 		return;
 	if (!(page = get_free_page()))
@@ -663,7 +1194,9 @@ void do_no_page(unsigned long error_code,unsigned long address)
 	bread_page(page,current->executable->i_dev,nr);
     // 在读设备逻辑块操作时，可能会出现这样一种情况，即在执行文件中的读取页面位
     // 置可能离文件尾不到1个页面的长度。因此就可能读入一些无用的信息，下面的操作
-    // 就是把这部分超出执行文件end_data以后的部分清零处理。
+    // 就是把这部分超出执行文件end_data以后的部分清零处理。下面的循环把tmp用作
+    // 页面中的地址，因此先把页面在文件中的偏移off保存下来，页面缓存以它为键。
+	off = tmp;
 	i = tmp + 4096 - current->end_data;
 	tmp = page + 4096;
 	while (i-- > 0) {
@@ -671,13 +1204,59 @@ void do_no_page(unsigned long error_code,unsigned long address)
 		*(char *)tmp = 0;
 	}
     // 最后把引起缺页异常的一页物理页面映射到指定线性地址address处。若操作成功
-    // 就返回。否则就释放内存页，显示内存不够。
-	if (put_page(page,address))
+    // 就返回。否则就释放内存页，显示内存不够。页面放入了缓存的话只读地映射。
+	if (add_cache_page(current->executable,off,page)) {
+		if (put_cached_page(page,address))
+			return;
+	} else if (put_page(page,address))
 		return;
 	free_page(page);
 	oom();
 }
 
+// head.s中内核代码段和数据段的段限长是16MB。内存超过16MB时把它们扩大到end_mem，
+// 并重新加载各段寄存器，让新的段限长生效。以后的任务切换和中断都会从gdt中重新加载。
+static void set_kernel_limit(unsigned long end_mem)
+{
+	unsigned long limit = (end_mem >> 12) - 1;
+	int i;
+
+	for (i = GDT_CODE ; i <= GDT_DATA ; i++) {
+		gdt[i].a = (gdt[i].a & 0xffff0000) | (limit & 0xffff);
+		gdt[i].b = (gdt[i].b & 0xfff0ffff) | (limit & 0xf0000);
+	}
+	__asm__("ljmp $0x08,$1f\n"
+		"1:\tmovl $0x10,%%eax\n\t"
+		"mov %%ax,%%ds\n\t"
+		"mov %%ax,%%es\n\t"
+		"mov %%ax,%%fs\n\t"
+		"mov %%ax,%%gs\n\t"
+		"mov %%ax,%%ss"
+		:::"ax");
+}
+
+// 把HEAD_MEMORY以上的物理内存对等地映射到内核的线性地址空间中，这样内核才能像访问
+// 低16MB那样直接访问这些页面。所需的页表取自start_mem处，返回新的start_mem。
+// 线性地址64MB以上是任务1以后各任务的空间，因此最多只能映射64MB的物理内存。
+static long map_high_memory(long start_mem, long end_mem)
+{
+	unsigned long addr, page, * pg_table;
+	int i;
+
+	for (addr = HEAD_MEMORY ; addr < end_mem ; addr += 0x400000) {
+		pg_table = (unsigned long *) start_mem;
+		start_mem += 4096;
+		for (i = 0 ; i < 1024 ; i++) {
+			page = addr + (i << 12);
+			pg_table[i] = (page < end_mem) ? (page | 7) : 0;
+		}
+		pg_dir[addr >> 22] = (unsigned long) pg_table | 7;
+	}
+	set_kernel_limit(end_mem);
+	invalidate();
+	return start_mem;
+}
+
 // 物理内存管理初始化
 // 该函数对1MB以上的内存区域以页面为单位进行管理前的初始化设置工作。一个页面长度
 // 为4KB bytes.该函数把1MB以上所有物理内存划分成一个个页面，并使用一个页面映射字节
@@ -685,7 +1264,8 @@ void do_no_page(unsigned long error_code,unsigned long address)
 // 项((16MB-1MB)/4KB)，即可管理3840个物理页面。每当一个物理内存页面被占用时就把
 // mem_map[]中对应的字节值增1；若释放一个物理页面，就把对应字节值减1。若字节值为0，
 // 则表示对应页面空闲；若字节值大于或等于1，则表示对应页面被占用或被不同程序共享占用。
-// 在该版本的Linux内核中，最多能管理16MB的物理内存，大于16MB的内存将弃之不用。
+// mem_map[]的大小按实际内存计算，放在主内存区的开始处。16MB以上的内存(最多到64MB)
+// 先由map_high_memory()映射进内核空间。
 // 对于具有16MB内存的PC机系统，在没有设置虚拟盘RAMDISK的情况下start_mem通常是4MB，
 // end_mem是16MB。因此此时主内存区范围是4MB-16MB,共有3072个物理页面可供分配。而
 // 范围0-1MB内存空间用于内核系统（其实内核只使用0-640Kb，剩下的部分被部分高速缓冲和
@@ -696,20 +1276,36 @@ void mem_init(long start_mem, long end_mem)
 {
 	int i;
 
-    // 首先将1MB到16MB范围内所有内存页面对应的内存映射字节数组项置为已占用状态，
-    // 即各项字节全部设置成USED(100)。PAGING_PAGES被定义为(PAGING_MEMORY>>12)，
-    // 即1MB以上所有物理内存分页后的内存页面数(15MB/4KB = 3840).
-	HIGH_MEMORY = end_mem;                  // 设置内存最高端(16MB)
-	for (i=0 ; i<PAGING_PAGES ; i++)
+    // 首先映射16MB以上的内存，然后在主内存区开始处分配mem_map[]和free_order[]两个
+    // 数组，各有PAGING_PAGES项，即1MB以上所有物理内存分页后的内存页面数(对于16MB内存
+    // 是15MB/4KB = 3840)。页表和这两个数组占用的内存不再属于主内存区。
+	HIGH_MEMORY = end_mem;                  // 设置内存最高端
+	clear_page(ZERO_PAGE);
+	start_mem = (start_mem + 4095) & ~4095;
+	if (end_mem > HEAD_MEMORY)
+		start_mem = map_high_memory(start_mem, end_mem);
+	paging_pages = (end_mem - LOW_MEM) >> 12;
+	mem_map = (unsigned char *) start_mem;
+	free_order = mem_map + PAGING_PAGES;
+	start_mem = (start_mem + 2*PAGING_PAGES + 4095) & ~4095;
+    // 然后将1MB以上所有内存页面对应的内存映射字节数组项置为已占用状态，即各项字节全部
+    // 设置成USED(100)。
+	for (i=0 ; i<PAGING_PAGES ; i++) {
 		mem_map[i] = USED;
+		free_order[i] = 0;
+	}
+	for (i=0 ; i<NR_PAGE_CACHE ; i++)
+		lru_insert(page_cache + i, 1);
     // 然后计算主内存区起始内存start_mem处页面对应内存映射字节数组中项号i和主内存区页面数。
     // 此时mem_map[]数组的第i项正对应主内存区中第1个页面。最后将主内存区中页面对应的数组项
     // 清零(表示空闲)。对于具有16MB物理内存的系统，mem_map[]中对应4MB-16MB主内存区的项被清零。
 	i = MAP_NR(start_mem);      // 主内存区其实位置处页面号
 	end_mem -= start_mem;
 	end_mem >>= 12;             // 主内存区中的总页面数
-	while (end_mem-->0)
-		mem_map[i++]=0;         // 主内存区页面对应字节值清零
+	while (end_mem-->0) {
+		mem_map[i]=0;           // 主内存区页面对应字节值清零
+		release_block(i++, 0);  // 并放入伙伴系统的空闲链表，相邻的空闲页面会合并
+	}
 }
 
 //// 计算内存空闲页面数并显示
@@ -0,0 +1,43 @@
+/*
+ *  linux/tools/bstat.c
+ */
+
+/*
+ * This prints the buffer-cache statistics the kernel keeps for every
+ * block device, as returned by the bstat() system call (see
+ * include/sys/bstat.h). Unlike the other tools it runs on the system
+ * itself: compile it there together with lib/bstat.c, unless bstat()
+ * is already in the library.
+ *
+ *	bstat
+ */
+
+#include <stdio.h>
+#include <sys/bstat.h>
+
+#define NR_BSTAT 16		/* as in <linux/fs.h> */
+#define HZ 100
+
+int main(void)
+{
+	struct bstat bs;
+	unsigned long total;
+	int i, n = 0;
+
+	printf("dev      hits    misses  hit%%     evict    dirty    reada   wait(ms)\n");
+	for (i = 0 ; i < NR_BSTAT ; i++) {
+		if (bstat(i,&bs) < 0)
+			continue;
+		total = bs.bs_hits + bs.bs_misses;
+		printf("%02x:%02x %9lu %9lu %4lu %9lu %8lu %8lu %10lu\n",
+			(int) (bs.bs_dev >> 8) & 0xff, (int) bs.bs_dev & 0xff,
+			bs.bs_hits, bs.bs_misses,
+			total ? bs.bs_hits * 100 / total : 0,
+			bs.bs_evict, bs.bs_dirty_evict, bs.bs_reada_drop,
+			bs.bs_wait * (1000 / HZ));
+		n++;
+	}
+	if (!n)
+		printf("no block device has been used yet\n");
+	return 0;
+}
@@ -0,0 +1,327 @@
+/*
+ *  linux/tools/schedtrace.c
+ */
+
+/*
+ * This decodes the scheduler events the kernel hands out with the
+ * schedtrace() system call (see include/sys/schedtrace.h). It runs on
+ * the host: a program on the traced system just calls schedtrace() in
+ * a loop and writes the events it gets, unchanged, to a file, which is
+ * then copied out of the emulator and fed to this.
+ *
+ *	schedtrace [-v] [-m System.map] [file]
+ *
+ * It prints a histogram of the wake-up to run latency (the time from
+ * SE_WAKEUP of a task to its SE_SWITCH_IN), and where tasks went to
+ * sleep. -v also lists every event. With -m, addresses are printed as
+ * symbol+offset.
+ */
+
+#include <stdio.h>	/* fprintf */
+#include <string.h>
+#include <stdlib.h>	/* contains exit */
+
+/*
+ * The events as the kernel writes them: an i386 'struct sched_event',
+ * which is not what the host compiler would make of it.
+ */
+#define EVENT_SIZE 20
+
+#define SE_WAKEUP	1
+#define SE_SLEEP	2
+#define SE_SWITCH_OUT	3
+#define SE_SWITCH_IN	4
+#define SE_LOST		5
+
+#define HZ 100
+#define LATCH (1193180/HZ)
+
+#define NR_PIDS 32768
+#define NR_BUCKETS 24
+#define NR_REASONS 256
+
+struct event {
+	unsigned long long time;	/* in 8253 clocks */
+	int type, state, pid, other;
+	unsigned long where;
+};
+
+struct symbol {
+	unsigned long addr;
+	char * name;
+};
+
+struct reason {
+	unsigned long where;
+	int state;
+	unsigned long count;
+};
+
+static struct symbol * symbols = NULL;
+static int nr_symbols = 0;
+
+static unsigned long long woken[NR_PIDS];	/* wake-up time + 1, or 0 */
+static unsigned long hist[NR_BUCKETS];
+static unsigned long nr_latency = 0;
+static unsigned long long sum_latency = 0, max_latency = 0;
+static unsigned long nr_lost = 0;
+
+static struct reason reasons[NR_REASONS];
+static int nr_reasons = 0;
+
+static const char * type_name[] = {
+	"?", "wakeup", "sleep", "out", "in", "lost"
+};
+
+static const char * state_name[] = {
+	"running", "interruptible", "uninterruptible", "zombie", "stopped"
+};
+
+void die(char * str)
+{
+	fprintf(stderr,"%s\n",str);
+	exit(1);
+}
+
+void usage(void)
+{
+	die("Usage: schedtrace [-v] [-m System.map] [file]");
+}
+
+static unsigned long get_long(unsigned char * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long) p[3] << 24);
+}
+
+static int get_short(unsigned char * p)
+{
+	return (short) (p[0] | (p[1] << 8));
+}
+
+static int read_event(FILE * f, struct event * e)
+{
+	unsigned char buf[EVENT_SIZE];
+
+	if (fread(buf,EVENT_SIZE,1,f) != 1)
+		return 0;
+	e->time = (unsigned long long) get_long(buf) * LATCH + get_long(buf+4);
+	e->type = buf[8];
+	e->state = buf[9];
+	e->pid = get_short(buf+10);
+	e->other = get_short(buf+12);
+	e->where = get_long(buf+16);
+	return 1;
+}
+
+static unsigned long usecs(unsigned long long clocks)
+{
+	return clocks * 1000000 / 1193180;
+}
+
+/*
+ * System.map is sorted by address, as the kernel Makefile makes it.
+ */
+static void read_map(char * name)
+{
+	FILE * f;
+	char line[256], sym[256], type;
+	unsigned long addr;
+	int size = 0;
+
+	if (!(f = fopen(name,"r")))
+		die("Unable to open System.map");
+	while (fgets(line,sizeof(line),f)) {
+		if (sscanf(line,"%lx %c %255s",&addr,&type,sym) != 3)
+			continue;
+		if (type != 't' && type != 'T')
+			continue;
+		if (nr_symbols == size) {
+			size = size ? size*2 : 1024;
+			if (!(symbols = realloc(symbols,size*sizeof(struct symbol))))
+				die("Out of memory");
+		}
+		symbols[nr_symbols].addr = addr;
+		if (!(symbols[nr_symbols].name = strdup(sym)))
+			die("Out of memory");
+		nr_symbols++;
+	}
+	fclose(f);
+}
+
+static const char * symbolize(unsigned long addr)
+{
+	static char buf[300];
+	int lo = 0, hi = nr_symbols;
+
+	while (hi - lo > 1) {
+		int mid = (lo + hi) / 2;
+
+		if (symbols[mid].addr <= addr)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (!nr_symbols || symbols[lo].addr > addr)
+		sprintf(buf,"%08lx",addr);
+	else
+		sprintf(buf,"%s+0x%lx",symbols[lo].name,addr - symbols[lo].addr);
+	return buf;
+}
+
+static const char * state_str(int state)
+{
+	if (state < 0 || state > 4)
+		return "?";
+	return state_name[state];
+}
+
+static void add_reason(unsigned long where, int state)
+{
+	int i;
+
+	for (i = 0 ; i < nr_reasons ; i++)
+		if (reasons[i].where == where && reasons[i].state == state) {
+			reasons[i].count++;
+			return;
+		}
+	if (nr_reasons == NR_REASONS)
+		return;
+	reasons[i].where = where;
+	reasons[i].state = state;
+	reasons[i].count = 1;
+	nr_reasons++;
+}
+
+static void add_latency(unsigned long long clocks)
+{
+	unsigned long us = usecs(clocks);
+	int i = 0;
+
+	while (us > 1 && i < NR_BUCKETS-1) {
+		us >>= 1;
+		i++;
+	}
+	hist[i]++;
+	nr_latency++;
+	sum_latency += clocks;
+	if (clocks > max_latency)
+		max_latency = clocks;
+}
+
+static void do_event(struct event * e, unsigned long long start, int verbose)
+{
+	if (verbose) {
+		printf("%12lu %-7s %5d",usecs(e->time - start),
+			type_name[(e->type > 5) ? 0 : e->type],e->pid);
+		switch (e->type) {
+			case SE_WAKEUP:
+				printf(" from %s by %d",state_str(e->state),e->other);
+				break;
+			case SE_SLEEP:
+				printf(" %s at %s",state_str(e->state),
+					symbolize(e->where));
+				break;
+			case SE_SWITCH_OUT:
+				printf(" %s at %s, to %d",state_str(e->state),
+					symbolize(e->where),e->other);
+				break;
+			case SE_SWITCH_IN:
+				printf(" after %d",e->other);
+				break;
+			case SE_LOST:
+				printf(" %lu events",e->where);
+				break;
+		}
+		putchar('\n');
+	}
+	switch (e->type) {
+		case SE_WAKEUP:
+			if (e->pid >= 0 && e->pid < NR_PIDS)
+				woken[e->pid] = e->time + 1;
+			break;
+		case SE_SLEEP:
+			add_reason(e->where,e->state);
+			break;
+		case SE_SWITCH_IN:
+			if (e->pid >= 0 && e->pid < NR_PIDS && woken[e->pid]) {
+				add_latency(e->time - (woken[e->pid] - 1));
+				woken[e->pid] = 0;
+			}
+			break;
+		case SE_LOST:
+			/* the wake-ups we have may not be the last ones */
+			memset(woken,0,sizeof(woken));
+			nr_lost += e->where;
+			break;
+	}
+}
+
+static int by_count(const void * a, const void * b)
+{
+	const struct reason * ra = a, * rb = b;
+
+	return (rb->count > ra->count) - (rb->count < ra->count);
+}
+
+static void report(void)
+{
+	unsigned long max = 0;
+	int i, n;
+
+	printf("wake-up to run latency: %lu samples",nr_latency);
+	if (nr_latency)
+		printf(", average %lu us, max %lu us",
+			usecs(sum_latency / nr_latency),usecs(max_latency));
+	if (nr_lost)
+		printf(", %lu events lost",nr_lost);
+	putchar('\n');
+	for (i = 0 ; i < NR_BUCKETS ; i++)
+		if (hist[i] > max)
+			max = hist[i];
+	for (i = 0 ; i < NR_BUCKETS ; i++) {
+		if (!hist[i])
+			continue;
+		n = hist[i] * 50 / max;
+		printf("%9lu us %8lu ",i ? 1UL << i : 0,hist[i]);
+		while (n--)
+			putchar('#');
+		putchar('\n');
+	}
+	qsort(reasons,nr_reasons,sizeof(struct reason),by_count);
+	printf("\nsleeps:\n");
+	for (i = 0 ; i < nr_reasons ; i++)
+		printf("%8lu %-15s %s\n",reasons[i].count,
+			state_str(reasons[i].state),symbolize(reasons[i].where));
+}
+
+int main(int argc, char ** argv)
+{
+	struct event e;
+	unsigned long long start = 0;
+	int verbose = 0, first = 1, i;
+	FILE * f = stdin;
+
+	for (i = 1 ; i < argc ; i++) {
+		if (!strcmp(argv[i],"-v"))
+			verbose = 1;
+		else if (!strcmp(argv[i],"-m")) {
+			if (++i == argc)
+				usage();
+			read_map(argv[i]);
+		} else if (argv[i][0] == '-' || f != stdin)
+			usage();
+		else if (!(f = fopen(argv[i],"rb")))
+			die("Unable to open trace file");
+	}
+	while (read_event(f,&e)) {
+		if (first) {
+			start = e.time;
+			first = 0;
+		}
+		do_event(&e,start,verbose);
+	}
+	if (verbose)
+		putchar('\n');
+	report();
+	return 0;
+}